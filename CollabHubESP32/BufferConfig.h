@@ -0,0 +1,214 @@
+#pragma once
+#include <stddef.h>
+// Every header that sizes a member from a config.h define (OfflineJournal,
+// ClockSync, PeerLink, ...) gets it through here, so all translation units
+// see the same overrides. Optional so the host tools build without one.
+#if defined(__has_include)
+#if __has_include("config.h")
+#include "config.h"
+#endif
+#endif
+
+// ================= BUFFER POLICY =================
+// Every buffer size used by WsClient, SioClient and the emitters comes from
+// one config struct. The active struct is CH_BUFFER_CONFIG (default
+// DefaultBufferConfig, sized from the CH_* defines below); set the defines in
+// config.h, or define CH_BUFFER_CONFIG to one of the presets or your own
+// struct with the same members.
+//
+// This header has no Arduino dependencies so tools/buffer_report.cpp can
+// print the footprint of each configuration on the host (including the
+// overrides of a config.h next to it).
+
+#ifndef CH_MAX_FRAME_SIZE
+#define CH_MAX_FRAME_SIZE 2048 // largest inbound WebSocket frame kept
+#endif
+#ifndef CH_TX_BUFFER_SIZE
+#define CH_TX_BUFFER_SIZE 512 // outbound frame / batch buffer (static)
+#endif
+#ifndef CH_IO_CHUNK_SIZE
+#define CH_IO_CHUNK_SIZE 128 // stack chunk for socket reads and large writes
+#endif
+#ifndef CH_OPEN_DOC_SIZE
+#define CH_OPEN_DOC_SIZE 256 // Engine.IO open packet
+#endif
+#ifndef CH_EVENT_DOC_SIZE
+#define CH_EVENT_DOC_SIZE 512 // inbound ["event", payload] array
+#endif
+#ifndef CH_PAYLOAD_DOC_SIZE
+#define CH_PAYLOAD_DOC_SIZE 512 // inbound payload re-serialised for handlers
+#endif
+#ifndef CH_EMIT_DOC_SIZE
+#define CH_EMIT_DOC_SIZE 256 // control/event emitters and onOpen messages
+#endif
+#ifndef CH_CHAT_DOC_SIZE
+#define CH_CHAT_DOC_SIZE 128 // chat emitter
+#endif
+#ifndef CH_MAX_NAMESPACES
+#define CH_MAX_NAMESPACES 4 // namespaces multiplexed on one connection
+#endif
+#ifndef CH_JOURNAL_STAGE_SIZE
+#define CH_JOURNAL_STAGE_SIZE 512 // offline journal RAM stage (static)
+#endif
+#ifndef CH_CONTROL_CACHE_SIZE
+#define CH_CONTROL_CACHE_SIZE 32 // control headers kept by the last-value cache
+#endif
+#ifndef CH_MAX_SCHEDULED
+#define CH_MAX_SCHEDULED 8 // time-stamped events waiting to fire
+#endif
+#ifndef CH_MAX_PENDING_ACKS
+#define CH_MAX_PENDING_ACKS 4 // emits waiting for a Socket.IO ack
+#endif
+#ifndef CH_MAX_PEERS
+#define CH_MAX_PEERS 8 // LAN peers tracked by PeerLink
+#endif
+#ifndef CH_PEER_DEDUP_SLOTS
+#define CH_PEER_DEDUP_SLOTS 16 // recent messages remembered for hub/peer dedup
+#endif
+#ifndef CH_PEER_PACKET_SIZE
+#define CH_PEER_PACKET_SIZE 256 // largest peer datagram (stack)
+#endif
+#ifndef CH_RAM_BUDGET
+#define CH_RAM_BUDGET 10240 // static + worst-case stack + worst-case heap
+#endif
+#ifndef CH_STACK_BUDGET
+#define CH_STACK_BUDGET 3072 // share of the 8 KB Arduino loop task stack
+#endif
+
+// SerialBridge sizes (SERIAL_BRIDGE in config.h), here so the budget below
+// can count them.
+#ifndef SERIAL_BRIDGE_PACKET_SIZE
+#define SERIAL_BRIDGE_PACKET_SIZE 512 // largest decoded packet
+#endif
+#ifndef SERIAL_BRIDGE_WINDOW
+#define SERIAL_BRIDGE_WINDOW 8 // packets the host may send ahead of credits
+#endif
+// Largest encoded frame: COBS overhead, CRC and both 0x00 delimiters.
+#define SERIAL_BRIDGE_FRAME_SIZE (SERIAL_BRIDGE_PACKET_SIZE + SERIAL_BRIDGE_PACKET_SIZE / 254 + 3)
+
+struct DefaultBufferConfig
+{
+  static constexpr size_t kMaxFrameSize = CH_MAX_FRAME_SIZE;
+  static constexpr size_t kTxBufferSize = CH_TX_BUFFER_SIZE;
+  static constexpr size_t kIoChunkSize = CH_IO_CHUNK_SIZE;
+  static constexpr size_t kOpenDocSize = CH_OPEN_DOC_SIZE;
+  static constexpr size_t kEventDocSize = CH_EVENT_DOC_SIZE;
+  static constexpr size_t kPayloadDocSize = CH_PAYLOAD_DOC_SIZE;
+  static constexpr size_t kEmitDocSize = CH_EMIT_DOC_SIZE;
+  static constexpr size_t kChatDocSize = CH_CHAT_DOC_SIZE;
+  static constexpr size_t kMaxNamespaces = CH_MAX_NAMESPACES;
+  static constexpr size_t kJournalStageSize = CH_JOURNAL_STAGE_SIZE;
+  static constexpr size_t kControlCacheSize = CH_CONTROL_CACHE_SIZE;
+  static constexpr size_t kMaxScheduled = CH_MAX_SCHEDULED;
+  static constexpr size_t kMaxPendingAcks = CH_MAX_PENDING_ACKS;
+  static constexpr size_t kMaxPeers = CH_MAX_PEERS;
+  static constexpr size_t kPeerDedupSlots = CH_PEER_DEDUP_SLOTS;
+  static constexpr size_t kPeerPacketSize = CH_PEER_PACKET_SIZE;
+  static constexpr size_t kRamBudget = CH_RAM_BUDGET;
+  static constexpr size_t kStackBudget = CH_STACK_BUDGET;
+};
+
+// Smaller footprint for builds sharing RAM with e.g. a large audio buffer.
+// Inbound messages above 512 bytes are dropped.
+struct SmallBufferConfig
+{
+  static constexpr size_t kMaxFrameSize = 512;
+  static constexpr size_t kTxBufferSize = 256;
+  static constexpr size_t kIoChunkSize = 64;
+  static constexpr size_t kOpenDocSize = 192;
+  static constexpr size_t kEventDocSize = 256;
+  static constexpr size_t kPayloadDocSize = 256;
+  static constexpr size_t kEmitDocSize = 160;
+  static constexpr size_t kChatDocSize = 128;
+  static constexpr size_t kMaxNamespaces = 2;
+  static constexpr size_t kJournalStageSize = 128;
+  static constexpr size_t kControlCacheSize = 4;
+  static constexpr size_t kMaxScheduled = 2;
+  static constexpr size_t kMaxPendingAcks = 2;
+  static constexpr size_t kMaxPeers = 2;
+  static constexpr size_t kPeerDedupSlots = 4;
+  static constexpr size_t kPeerPacketSize = 128;
+  static constexpr size_t kRamBudget = 3584;
+  static constexpr size_t kStackBudget = 1152;
+};
+
+// Per-slot sizes of the fixed arrays inside the client objects. The sketch
+// build checks the budget with sizeof of the real structs (ClientSlotSizes in
+// SioClient.h); these ESP32 figures are only used by tools/buffer_report.cpp,
+// which cannot see the Arduino types.
+struct Esp32SlotSizes
+{
+  static constexpr size_t kNamespace = 48; // name String, flags, open handler, handler map
+  static constexpr size_t kScheduled = 48; // fire time, handler, String
+  static constexpr size_t kAck = 32;
+  static constexpr size_t kPeer = 28;
+  static constexpr size_t kDedup = 12;
+  static constexpr size_t kControl = 72; // ControlCache::Entry
+};
+
+template <class Cfg, class Slots = Esp32SlotSizes>
+struct BufferBudget
+{
+  static constexpr size_t max2(size_t a, size_t b) { return a > b ? a : b; }
+  static constexpr size_t pow2(size_t n, size_t p = 1) { return p >= n ? p : pow2(n, p << 1); }
+
+#if defined(SERIAL_BRIDGE) && SERIAL_BRIDGE
+  // SerialBridge: the receive buffer is static; a message to the host builds
+  // the packet and its encoded frame on the handler's stack, and a packet
+  // from the host copies its namespace and event names before emit().
+  static constexpr size_t bridgeStaticBytes = SERIAL_BRIDGE_FRAME_SIZE - 2;
+  static constexpr size_t bridgeSendStack = SERIAL_BRIDGE_PACKET_SIZE + SERIAL_BRIDGE_FRAME_SIZE;
+  static constexpr size_t bridgeEmitStack = 2 * 64;
+#else
+  static constexpr size_t bridgeStaticBytes = 0;
+  static constexpr size_t bridgeSendStack = 0;
+  static constexpr size_t bridgeEmitStack = 0;
+#endif
+
+  // Buffers embedded in the client objects.
+  static constexpr size_t staticBytes = Cfg::kTxBufferSize + Cfg::kJournalStageSize +
+                                        Cfg::kMaxNamespaces * Slots::kNamespace +
+                                        Cfg::kMaxScheduled * Slots::kScheduled +
+                                        Cfg::kMaxPendingAcks * Slots::kAck +
+                                        Cfg::kMaxPeers * Slots::kPeer +
+                                        Cfg::kPeerDedupSlots * Slots::kDedup +
+                                        bridgeStaticBytes;
+
+  // Deepest stack path: loop() -> _handleText (event doc + payload doc), or
+  // a peer datagram (packet + its doc + _dispatchPeerMessage's doc) -> user
+  // handler -> emitter doc -> emit(), which first sends to peers
+  // (_sendToPeers' doc + datagram body + packet) and then calls sendText
+  // (header + chunk); or the bridge's outbound packet in bridge mode. The
+  // other bridge path, poll() -> emit(), starts from loop() and does not nest
+  // inside _handleText. The read chunk in _readFrame is released before
+  // dispatch.
+  static constexpr size_t handleTextStack = max2(max2(Cfg::kOpenDocSize, Cfg::kEventDocSize + Cfg::kPayloadDocSize),
+                                                 Cfg::kPeerPacketSize + 2 * Cfg::kEmitDocSize);
+  static constexpr size_t emitStack = max2(Cfg::kEmitDocSize, Cfg::kChatDocSize) +
+                                      max2(Cfg::kIoChunkSize + 8, Cfg::kEmitDocSize + 2 * Cfg::kPeerPacketSize);
+  static constexpr size_t stackBytes = max2(handleTextStack + max2(emitStack, bridgeSendStack),
+                                            bridgeEmitStack + emitStack);
+
+  // Heap: frame buffer + re-serialised payload + outbound JSON text, plus the
+  // control cache table (rounded up to a power of two slots by
+  // ControlCache::begin) when enabled.
+  static constexpr size_t heapBytes = Cfg::kMaxFrameSize + Cfg::kPayloadDocSize + Cfg::kEmitDocSize +
+                                      pow2(Cfg::kControlCacheSize) * Slots::kControl;
+
+  static constexpr size_t totalBytes = staticBytes + stackBytes + heapBytes;
+
+  static constexpr bool fitsStack = stackBytes <= Cfg::kStackBudget;
+  static constexpr bool fitsRam = totalBytes <= Cfg::kRamBudget;
+  static constexpr bool valid = Cfg::kTxBufferSize >= 16 && Cfg::kIoChunkSize >= 16 && Cfg::kMaxFrameSize >= 64 && Cfg::kMaxNamespaces >= 1 &&
+                               Cfg::kMaxScheduled >= 1 && Cfg::kMaxPendingAcks >= 1 &&
+                               Cfg::kMaxPeers >= 1 && Cfg::kPeerDedupSlots >= 1 && Cfg::kPeerPacketSize >= 64;
+};
+
+#ifndef CH_BUFFER_CONFIG
+#define CH_BUFFER_CONFIG DefaultBufferConfig
+#endif
+using ChBuffers = CH_BUFFER_CONFIG;
+
+// The RAM and stack budgets are checked in SioClient.h, against the real
+// slot sizes.
+static_assert(BufferBudget<ChBuffers>::valid, "CH buffer sizes too small");
@@ -0,0 +1,112 @@
+#include "ClockSync.h"
+
+// micros() extended to 64 bits (it wraps every ~71 minutes).
+uint64_t ClockSync::localUs()
+{
+  uint32_t now = micros();
+  if (now < _lastMicros)
+    _microsHigh += 1ULL << 32;
+  _lastMicros = now;
+  return _microsHigh | now;
+}
+
+bool ClockSync::due(uint32_t nowMs)
+{
+  uint32_t interval = _count < kSamples ? CLOCK_SYNC_FAST_INTERVAL_MS : CLOCK_SYNC_INTERVAL_MS;
+  if (_requested && (uint32_t)(nowMs - _lastRequestMs) < interval)
+    return false;
+  _requested = true;
+  _lastRequestMs = nowMs;
+  return true;
+}
+
+void ClockSync::addSample(uint64_t t0Us, int64_t serverMs, uint64_t t3Us)
+{
+  if (t3Us < t0Us)
+    return;
+  Sample s;
+  s.rttUs = (uint32_t)(t3Us - t0Us);
+  // Server stamps have 1 ms resolution; centre them in their millisecond.
+  s.offsetUs = serverMs * 1000 + 500 - (int64_t)((t0Us + t3Us) / 2);
+  _samples[_next] = s;
+  _next = (_next + 1) % kSamples;
+  if (_count < kSamples)
+    _count++;
+  size_t best = 0;
+  for (size_t i = 1; i < _count; ++i)
+    if (_samples[i].rttUs < _samples[best].rttUs)
+      best = i;
+  _offsetUs = _samples[best].offsetUs;
+  _rttUs = _samples[best].rttUs;
+}
+
+uint32_t ClockSync::sharedMs()
+{
+  return (uint32_t)(((int64_t)localUs() + _offsetUs) / 1000);
+}
+
+uint64_t ClockSync::sharedToLocalUs(uint32_t sharedMs)
+{
+  int64_t nowSharedUs = (int64_t)localUs() + _offsetUs;
+  int64_t nowSharedMs = nowSharedUs / 1000;
+  int32_t deltaMs = (int32_t)(sharedMs - (uint32_t)nowSharedMs);
+  int64_t targetLocal = (nowSharedMs + deltaMs) * 1000 - _offsetUs;
+  return targetLocal > 0 ? (uint64_t)targetLocal : 0;
+}
+
+// Queues json for handler at the given shared time. Events that are already
+// due, that find the queue full, or that are stamped more than
+// CLOCK_SYNC_MAX_AHEAD_MS ahead (a sender with a bad clock) fire immediately.
+bool ClockSync::schedule(uint32_t sharedMs, const TextHandler &handler, const char *json, size_t len)
+{
+  uint64_t fireUs = sharedToLocalUs(sharedMs);
+  if (fireUs > localUs() + (uint64_t)CLOCK_SYNC_MAX_AHEAD_MS * 1000)
+  {
+    _far++;
+    handler(json, len);
+    return false;
+  }
+  for (size_t i = 0; i < ChBuffers::kMaxScheduled; ++i)
+  {
+    Scheduled &s = _queue[i];
+    if (s.used)
+      continue;
+    s.used = true;
+    s.fireUs = fireUs;
+    s.handler = handler;
+    s.json = "";
+    s.json.concat(json, len);
+    tick();
+    return true;
+  }
+  _late++;
+  handler(json, len);
+  return false;
+}
+
+void ClockSync::tick()
+{
+  uint64_t now = localUs();
+  for (size_t i = 0; i < ChBuffers::kMaxScheduled; ++i)
+  {
+    if (_queue[i].used && _queue[i].fireUs <= now)
+      _fire(_queue[i], now);
+  }
+}
+
+void ClockSync::_fire(Scheduled &s, uint64_t nowUs)
+{
+  int64_t err = (int64_t)nowUs - (int64_t)s.fireUs;
+  _lastFireErrorUs = err > INT32_MAX ? INT32_MAX : (int32_t)err;
+  if (_lastFireErrorUs > _maxFireErrorUs)
+    _maxFireErrorUs = _lastFireErrorUs;
+  if (err > 1000)
+    _late++;
+  // Release the slot before calling out: the handler may schedule again.
+  TextHandler handler = s.handler;
+  String json = s.json;
+  s.used = false;
+  s.handler = nullptr;
+  s.json = "";
+  handler(json.c_str(), json.length());
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include <Arduino.h>
+#include <functional>
+#include "BufferConfig.h"
+
+// Sync cadence; override in config.h.
+#ifndef CLOCK_SYNC_FAST_INTERVAL_MS
+#define CLOCK_SYNC_FAST_INTERVAL_MS 500 // until the sample window is full
+#endif
+#ifndef CLOCK_SYNC_INTERVAL_MS
+#define CLOCK_SYNC_INTERVAL_MS 15000
+#endif
+#ifndef CLOCK_SYNC_MAX_AHEAD_MS
+#define CLOCK_SYNC_MAX_AHEAD_MS 5000 // events stamped further ahead fire on arrival
+#endif
+
+// NTP-style estimate of the hub's clock over the Socket.IO connection, plus
+// a small queue that fires received, time-stamped events at a shared time.
+//
+// Each sample is one request/ack round trip: t0 (local send), the server's
+// timestamp, t3 (local receive). offset = server - (t0 + t3) / 2. Of the last
+// kSamples, the one with the smallest round trip is used, because queueing
+// delay only ever adds to the RTT, so that sample has the least asymmetry
+// and the outliers fall out.
+//
+// Shared time is the server's millisecond clock truncated to 32 bits. It
+// wraps like millis(), so compare shared times by subtraction. All devices
+// agree on it without 64-bit JSON numbers.
+class ClockSync
+{
+public:
+  using TextHandler = std::function<void(const char *, size_t)>;
+  static const size_t kSamples = 8;
+
+  uint64_t localUs();
+  bool due(uint32_t nowMs);
+  void addSample(uint64_t t0Us, int64_t serverMs, uint64_t t3Us);
+  bool synced() const { return _count > 0; }
+  int64_t offsetUs() const { return _offsetUs; }
+  uint32_t rttUs() const { return _rttUs; }
+
+  uint32_t sharedMs();
+  uint64_t sharedToLocalUs(uint32_t sharedMs);
+
+  bool schedule(uint32_t sharedMs, const TextHandler &handler, const char *json, size_t len);
+  void tick();
+
+  // Difference between when scheduled events actually fired and their target,
+  // in microseconds (positive = late).
+  int32_t lastFireErrorUs() const { return _lastFireErrorUs; }
+  int32_t maxFireErrorUs() const { return _maxFireErrorUs; }
+  uint32_t lateEvents() const { return _late; }
+  uint32_t farEvents() const { return _far; }
+
+private:
+  friend struct ClientSlotSizes;
+  struct Sample
+  {
+    int64_t offsetUs;
+    uint32_t rttUs;
+  };
+  struct Scheduled
+  {
+    bool used = false;
+    uint64_t fireUs = 0;
+    TextHandler handler = nullptr;
+    String json;
+  };
+
+  void _fire(Scheduled &s, uint64_t nowUs);
+
+  Sample _samples[kSamples];
+  size_t _count = 0;
+  size_t _next = 0;
+  int64_t _offsetUs = 0;
+  uint32_t _rttUs = 0;
+  uint32_t _lastRequestMs = 0;
+  bool _requested = false;
+
+  uint32_t _lastMicros = 0;
+  uint64_t _microsHigh = 0;
+
+  Scheduled _queue[ChBuffers::kMaxScheduled];
+  int32_t _lastFireErrorUs = 0;
+  int32_t _maxFireErrorUs = 0;
+  uint32_t _late = 0;
+  uint32_t _far = 0;
+};
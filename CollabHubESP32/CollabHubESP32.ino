@@ -4,12 +4,88 @@
 #include "config.h"
 #include "SioClient.h"
 #include "user_script.h"
+#include "Profiler.h"
 
 #ifndef LED_BUILTIN
 #define LED_BUILTIN 2
 #endif
 
+// Optional extra hubs (config.h); the fastest reachable one is used.
+#ifndef HUB_LOCAL_PORT
+#define HUB_LOCAL_PORT 3000
+#endif
+#ifndef HUB_LOCAL_TLS
+#define HUB_LOCAL_TLS false
+#endif
+#ifndef HUB_BACKUP_PORT
+#define HUB_BACKUP_PORT HUB_PORT
+#endif
+#ifndef HUB_BACKUP_TLS
+#define HUB_BACKUP_TLS USE_TLS
+#endif
+
+// Keep messages emitted while offline and send them after reconnecting.
+#ifndef SIO_OFFLINE_JOURNAL
+#define SIO_OFFLINE_JOURNAL false
+#endif
+#ifndef JOURNAL_PATH
+#define JOURNAL_PATH "/outbox.jnl"
+#endif
+
+// Also send controls/events straight to devices in the same room on the LAN.
+#ifndef SIO_PEER_LINK
+#define SIO_PEER_LINK false
+#endif
+
+// Keep the latest value of every received control (sio.controls()).
+#ifndef SIO_CONTROL_CACHE
+#define SIO_CONTROL_CACHE false
+#endif
+
+// Binary host gateway on the USB serial port (see SerialBridge.h). Boot text
+// is still printed and discarded by the host; after setup() nothing in this
+// file prints, and received messages only go to the host, not to the
+// printing example handlers in user_script.cpp.
+#ifndef SERIAL_BRIDGE
+#define SERIAL_BRIDGE false
+#endif
+#ifndef SERIAL_BRIDGE_BAUD
+#define SERIAL_BRIDGE_BAUD 921600
+#endif
+#ifndef SERIAL_BRIDGE_RX_BUFFER
+#define SERIAL_BRIDGE_RX_BUFFER (SERIAL_BRIDGE_WINDOW * SERIAL_BRIDGE_FRAME_SIZE) // a full window
+#endif
+
+// Status text printed from loop(); silent in bridge mode.
+#if SERIAL_BRIDGE
+#define LOOP_LOG(msg)
+#else
+#define LOOP_LOG(msg) Serial.println(msg)
+#endif
+
 SioClient sio;
+#if SERIAL_BRIDGE
+#include "SerialBridge.h"
+// Bytes that arrive while loop() is busy must all fit, or frames are lost.
+static_assert(SERIAL_BRIDGE_RX_BUFFER >= SERIAL_BRIDGE_WINDOW * SERIAL_BRIDGE_FRAME_SIZE,
+              "SERIAL_BRIDGE_RX_BUFFER must hold SERIAL_BRIDGE_WINDOW frames");
+SerialBridge bridge;
+
+void bridgeControl(const char *json, size_t len)
+{
+    bridge.sendMessage(nullptr, "control", json, len);
+}
+
+void bridgeEvent(const char *json, size_t len)
+{
+    bridge.sendMessage(nullptr, "event", json, len);
+}
+
+void bridgeChat(const char *json, size_t len)
+{
+    bridge.sendMessage(nullptr, "chat", json, len);
+}
+#endif
 
 String generateUsername()
 {
@@ -22,7 +98,18 @@ String generateUsername()
 
 void setup()
 {
+#if SERIAL_BRIDGE
+    Serial.setRxBufferSize(SERIAL_BRIDGE_RX_BUFFER);
+    Serial.begin(SERIAL_BRIDGE_BAUD);
+    bridge.begin(Serial, [](const char *nsp, const char *event, const char *payload)
+                 {
+                    if (nsp)
+                        sio.emit(nsp, event, payload);
+                    else
+                        sio.emit(event, payload); });
+#else
     Serial.begin(115200);
+#endif
     delay(200);
     Serial.println();
     Serial.println("[Collab-Hub ESP32] Booting...");
@@ -57,28 +144,58 @@ void setup()
     sio.onOpen([]()
                {
                 String username = generateUsername();
-                StaticJsonDocument<64> d1;
-                d1["username"] = username;
-                String s1; serializeJson(d1, s1);
+                sio.beginBatch();
+                StaticJsonDocument<ChBuffers::kEmitDocSize> doc;
+                doc["username"] = username;
+                String s1; serializeJson(doc, s1);
                 sio.emit("addUsername", s1.c_str());
 
-                StaticJsonDocument<128> d2;
-                d2["room"] = IOT_ROOM;
-                String s2; serializeJson(d2, s2);
+                doc.clear();
+                doc["room"] = IOT_ROOM;
+                String s2; serializeJson(doc, s2);
                 sio.emit("joinRoom", s2.c_str());
 
-                StaticJsonDocument<64> d3;
-                d3["observe"] = true;
-                String s3; serializeJson(d3, s3);
+                doc.clear();
+                doc["observe"] = true;
+                String s3; serializeJson(doc, s3);
                 sio.emit("observeAllControl", s3.c_str());
                 sio.emit("observeAllEvents", s3.c_str());
+                sio.flush();
 
-                onConnected(username); });
+#if !SERIAL_BRIDGE
+                onConnected(username);
+#endif
+               });
 
+#if SERIAL_BRIDGE
+    sio.on("control", bridgeControl);
+    sio.on("event", bridgeEvent);
+    sio.on("chat", bridgeChat);
+#else
     sio.on("control", onControlMessage);
     sio.on("event", onEventMessage);
     sio.on("chat", onChatMessage);
+#endif
 
+#if SIO_CONTROL_CACHE
+    sio.enableControlCache();
+#endif
+#ifdef CLOCK_SYNC_EVENT
+    sio.enableClockSync(CLOCK_SYNC_EVENT);
+#endif
+#if SIO_PEER_LINK
+    sio.enablePeers(IOT_ROOM);
+#endif
+#if SIO_OFFLINE_JOURNAL
+    if (!sio.enableJournal(JOURNAL_PATH))
+        Serial.println("Offline journal unavailable (LittleFS mount failed)");
+#endif
+#ifdef HUB_LOCAL_HOST
+    sio.addEndpoint(HUB_LOCAL_HOST, HUB_LOCAL_PORT, HUB_LOCAL_TLS);
+#endif
+#ifdef HUB_BACKUP_HOST
+    sio.addEndpoint(HUB_BACKUP_HOST, HUB_BACKUP_PORT, HUB_BACKUP_TLS);
+#endif
     String username = generateUsername();
     sio.begin(HUB_HOST, HUB_PORT, HUB_NAMESPACE, USE_TLS, username.c_str());
 }
@@ -93,14 +210,35 @@ void loop()
     static unsigned long lastWifiAttempt = 0;
     static unsigned long wifiRetryIntervalMs = 5000;
     static bool shouldReconnect = false;
+    CH_PROFILE_SCOPE("loop");
+#if CH_PROFILE && !SERIAL_BRIDGE
+    // Send 't' on the serial monitor for a Chrome trace, 's' for a summary.
+    if (Serial.available())
+    {
+        int cmd = Serial.read();
+        if (cmd == 't')
+            Profiler::exportChromeTrace(Serial);
+        else if (cmd == 's')
+            Profiler::printSummary(Serial);
+        if (cmd == 't' || cmd == 's')
+            Profiler::clear();
+    }
+#endif
     sio.loop();
+#if SERIAL_BRIDGE
+    bridge.poll(sio.connected());
+#endif
     unsigned long now = millis();
-    userScriptLoop();
+    {
+        CH_PROFILE_SCOPE("userScriptLoop");
+        userScriptLoop();
+    }
     if (WiFi.status() != WL_CONNECTED)
     {
         if (now - lastWifiAttempt > wifiRetryIntervalMs)
         {
-            Serial.println("[ESP32] WiFi disconnected, attempting reconnect...");
+            CH_PROFILE_SCOPE("wifi.reconnect");
+            LOOP_LOG("[ESP32] WiFi disconnected, attempting reconnect...");
             WiFi.disconnect();
             WiFi.begin(WIFI_SSID, WIFI_PASS);
             lastWifiAttempt = now;
@@ -117,13 +255,14 @@ void loop()
     {
         if (!shouldReconnect)
         {
-            Serial.println("[ESP32] Disconnected from server, will attempt reconnect...");
+            LOOP_LOG("[ESP32] Disconnected from server, will attempt reconnect...");
             shouldReconnect = true;
             lastReconnectAttempt = now;
         }
         if (shouldReconnect && (now - lastReconnectAttempt > reconnectIntervalMs))
         {
-            Serial.println("[ESP32] Attempting reconnect...");
+            CH_PROFILE_SCOPE("hub.reconnect");
+            LOOP_LOG("[ESP32] Attempting reconnect...");
             sio.begin(HUB_HOST, HUB_PORT, HUB_NAMESPACE, USE_TLS);
             shouldReconnect = false;
             if (reconnectIntervalMs < 60000UL)
@@ -0,0 +1,93 @@
+#include "ControlCache.h"
+#include <new>
+#include <string.h>
+
+static uint32_t _hashHeader(const char *s)
+{
+  uint32_t h = 2166136261u;
+  while (*s)
+  {
+    h ^= (uint8_t)*s++;
+    h *= 16777619u;
+  }
+  return h;
+}
+
+bool ControlCache::begin(size_t capacity)
+{
+  if (_entries)
+    return true;
+  size_t cap = 1;
+  while (cap < capacity)
+    cap <<= 1;
+  _entries = new (std::nothrow) Entry[cap];
+  if (!_entries)
+    return false;
+  _capacity = cap;
+  return true;
+}
+
+// Linear probe for header: returns its slot, the empty slot where it would
+// go, or nullptr if the table is full and the header is absent.
+ControlCache::Entry *ControlCache::_slot(const char *header, uint32_t hash) const
+{
+  size_t mask = _capacity - 1;
+  for (size_t i = 0; i < _capacity; ++i)
+  {
+    Entry *e = &_entries[(hash + i) & mask];
+    if (e->seq == 0)
+      return e;
+    if (e->hash == hash && strncmp(e->header, header, kMaxHeader - 1) == 0)
+      return e;
+  }
+  return nullptr;
+}
+
+bool ControlCache::update(const char *header, float value, const char *from, uint32_t now)
+{
+  if (!_entries || !header || !*header)
+    return false;
+  uint32_t hash = _hashHeader(header);
+  Entry *e = _slot(header, hash);
+  if (!e)
+  {
+    _overflow++;
+    return false;
+  }
+  if (!from)
+    from = "";
+  bool fresh = e->seq == 0;
+  if (fresh)
+  {
+    strncpy(e->header, header, kMaxHeader - 1);
+    e->hash = hash;
+    _count++;
+  }
+  e->arrivalMs = now;
+  if (fresh || e->value != value || strncmp(e->from, from, kMaxFrom - 1) != 0)
+  {
+    e->value = value;
+    strncpy(e->from, from, kMaxFrom - 1);
+    if (++_seq == 0) // 0 marks an empty slot
+      ++_seq;
+    e->seq = _seq;
+  }
+  return true;
+}
+
+const ControlCache::Entry *ControlCache::find(const char *header) const
+{
+  if (!_entries || !header)
+    return nullptr;
+  const Entry *e = _slot(header, _hashHeader(header));
+  return (e && e->seq != 0) ? e : nullptr;
+}
+
+bool ControlCache::get(const char *header, float &value) const
+{
+  const Entry *e = find(header);
+  if (!e)
+    return false;
+  value = e->value;
+  return true;
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <Arduino.h>
+
+// Latest received value per control header, filled by SioClient as "control"
+// messages are dispatched. Lookup is a hash probe (no JSON parsing), so a
+// render or actuator loop can sample state at its own rate.
+//
+// The table has a fixed number of slots allocated once by begin() and never
+// rehashed or shrunk: a pointer returned by find() stays valid and always
+// shows the latest value for that header. When every slot is taken, new
+// headers are counted in overflow() and not stored.
+class ControlCache
+{
+public:
+  static const size_t kMaxHeader = 32;
+  static const size_t kMaxFrom = 24;
+
+  struct Entry
+  {
+    char header[kMaxHeader] = {0};
+    char from[kMaxFrom] = {0};
+    float value = 0.0f;
+    uint32_t arrivalMs = 0;
+    uint32_t seq = 0; // cache seq() at this entry's last change; 0 = empty
+    uint32_t hash = 0;
+  };
+
+  ~ControlCache() { delete[] _entries; }
+  bool begin(size_t capacity);
+  bool enabled() const { return _entries != nullptr; }
+  bool update(const char *header, float value, const char *from, uint32_t now);
+  const Entry *find(const char *header) const;
+  bool get(const char *header, float &value) const;
+
+  // Incremented whenever any entry's value or sender changes. Compare with a
+  // stored copy to skip work when nothing changed.
+  uint32_t seq() const { return _seq; }
+  size_t size() const { return _count; }
+  size_t capacity() const { return _capacity; }
+  uint32_t overflow() const { return _overflow; }
+
+private:
+  Entry *_slot(const char *header, uint32_t hash) const;
+
+  Entry *_entries = nullptr;
+  size_t _capacity = 0; // power of two
+  size_t _count = 0;
+  uint32_t _seq = 0;
+  uint32_t _overflow = 0;
+};
@@ -0,0 +1,143 @@
+#include "EndpointRace.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#ifdef ARDUINO
+#include <lwip/sockets.h>
+#include <lwip/netdb.h>
+#else
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <netdb.h>
+#endif
+
+static int _openNonBlocking(uint32_t addr, uint16_t port)
+{
+  if (addr == 0)
+    return -1;
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0)
+    return -1;
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+  struct sockaddr_in sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sin_family = AF_INET;
+  sa.sin_port = htons(port);
+  sa.sin_addr.s_addr = addr;
+  int rc = connect(fd, (struct sockaddr *)&sa, sizeof(sa));
+  if (rc < 0 && errno != EINPROGRESS)
+  {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// Blocking DNS lookup of endpoint.host. On failure the previous address is
+// kept, so a hub that was found before is still probed.
+bool EndpointRace::resolve(HubEndpoint &endpoint)
+{
+  struct addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  struct addrinfo *res = nullptr;
+  if (getaddrinfo(endpoint.host.c_str(), nullptr, &hints, &res) != 0 || !res)
+    return false;
+  endpoint.addr = ((struct sockaddr_in *)res->ai_addr)->sin_addr.s_addr;
+  freeaddrinfo(res);
+  return true;
+}
+
+bool EndpointRace::start(HubEndpoint *endpoints, size_t count, uint32_t timeoutMs)
+{
+  cancel();
+  _endpoints = endpoints;
+  _count = count < kMaxEndpoints ? count : kMaxEndpoints;
+  _timeoutMs = timeoutMs;
+  _startMs = millis();
+  for (size_t i = 0; i < _count; ++i)
+  {
+    _endpoints[i].reachable = false;
+    _endpoints[i].rttMs = 0;
+    _endpoints[i].rttMinMs = 0;
+    _fds[i] = _openNonBlocking(_endpoints[i].addr, _endpoints[i].port);
+    _sentUs[i] = micros();
+  }
+  _lastPollUs = micros();
+  _active = true;
+  return _count > 0;
+}
+
+bool EndpointRace::poll()
+{
+  if (!_active)
+    return true;
+  fd_set wset;
+  FD_ZERO(&wset);
+  int maxFd = -1;
+  for (size_t i = 0; i < _count; ++i)
+  {
+    if (_fds[i] < 0)
+      continue;
+    FD_SET(_fds[i], &wset);
+    if (_fds[i] > maxFd)
+      maxFd = _fds[i];
+  }
+  uint32_t nowUs = micros();
+  if (maxFd >= 0)
+  {
+    struct timeval tv = {0, 0};
+    if (select(maxFd + 1, nullptr, &wset, nullptr, &tv) > 0)
+    {
+      for (size_t i = 0; i < _count; ++i)
+      {
+        if (_fds[i] < 0 || !FD_ISSET(_fds[i], &wset))
+          continue;
+        int err = 0;
+        socklen_t len = sizeof(err);
+        getsockopt(_fds[i], SOL_SOCKET, SO_ERROR, &err, &len);
+        if (err == 0)
+        {
+          uint32_t sinceLast = (int32_t)(_lastPollUs - _sentUs[i]) > 0 ? _lastPollUs - _sentUs[i] : 0;
+          _endpoints[i].reachable = true;
+          _endpoints[i].rttMs = (nowUs - _sentUs[i] + 999) / 1000;
+          _endpoints[i].rttMinMs = sinceLast / 1000;
+        }
+        close(_fds[i]);
+        _fds[i] = -1;
+      }
+    }
+  }
+  _lastPollUs = nowUs;
+  bool pending = false;
+  for (size_t i = 0; i < _count; ++i)
+    pending = pending || _fds[i] >= 0;
+  if (pending && (uint32_t)(millis() - _startMs) < _timeoutMs)
+    return false;
+  cancel();
+  return true;
+}
+
+// Blocking convenience used on (re)connect; refreshes every address first.
+void EndpointRace::run(HubEndpoint *endpoints, size_t count, uint32_t timeoutMs)
+{
+  for (size_t i = 0; i < count && i < kMaxEndpoints; ++i)
+    resolve(endpoints[i]);
+  start(endpoints, count, timeoutMs);
+  while (!poll())
+    delay(1);
+}
+
+void EndpointRace::cancel()
+{
+  for (size_t i = 0; i < kMaxEndpoints; ++i)
+  {
+    if (_fds[i] >= 0)
+      close(_fds[i]);
+    _fds[i] = -1;
+  }
+  _active = false;
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <Arduino.h>
+
+// A hub the client may connect to. addr is host's IPv4 address (network
+// order, 0 = not resolved yet), looked up by EndpointRace::resolve().
+// rttMs/reachable are filled in by EndpointRace from the most recent probe.
+// The connect is only seen on a poll(), so it completed somewhere between
+// rttMinMs and rttMs.
+struct HubEndpoint
+{
+  String host;
+  uint16_t port = 0;
+  bool useTls = false;
+  uint32_t addr = 0;
+  bool reachable = false;
+  uint32_t rttMs = 0;
+  uint32_t rttMinMs = 0;
+};
+
+// Races non-blocking TCP connects to several endpoints at once and records
+// each one's connect time (about one network round trip). Only TCP is
+// raced; the TLS/WebSocket handshake is done afterwards on the winner, so a
+// probe costs a socket per endpoint rather than a TLS session.
+//
+// start() kicks off the probe, poll() advances it without blocking and
+// returns true once every endpoint has answered or timeoutMs has elapsed.
+// Neither looks up host names: start() connects to the address from the
+// last resolve(), and endpoints without one count as unreachable. run(),
+// used on (re)connect where blocking is expected, resolves first.
+class EndpointRace
+{
+public:
+  static const size_t kMaxEndpoints = 4;
+
+  ~EndpointRace() { cancel(); }
+  static bool resolve(HubEndpoint &endpoint);
+  bool start(HubEndpoint *endpoints, size_t count, uint32_t timeoutMs);
+  bool poll();
+  void run(HubEndpoint *endpoints, size_t count, uint32_t timeoutMs);
+  void cancel();
+  bool active() const { return _active; }
+
+private:
+  HubEndpoint *_endpoints = nullptr;
+  size_t _count = 0;
+  int _fds[kMaxEndpoints] = {-1, -1, -1, -1};
+  uint32_t _sentUs[kMaxEndpoints] = {};
+  uint32_t _lastPollUs = 0;
+  uint32_t _startMs = 0;
+  uint32_t _timeoutMs = 0;
+  bool _active = false;
+};
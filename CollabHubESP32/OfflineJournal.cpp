@@ -0,0 +1,584 @@
+#include "OfflineJournal.h"
+#include <ArduinoJson.h>
+#include <stdio.h>
+#include <string.h>
+#ifdef ARDUINO
+#include <LittleFS.h>
+#endif
+
+namespace
+{
+  struct RecordHeader
+  {
+    uint8_t kind = 0; // 'C' compactable control, 'M' anything else, 'S' sent
+    uint32_t key = 0; // hash of namespace + control header
+    size_t nspLen = 0;
+    size_t evLen = 0;
+    size_t payLen = 0;
+    size_t bodySize() const { return nspLen + evLen + payLen; }
+  };
+
+  const size_t kHeaderSize = 9; // kind, key[4], nspLen, evLen, payLen[2]
+  const uint32_t kFnvBasis = 2166136261u;
+
+  void encodeHeader(uint8_t *p, const RecordHeader &h)
+  {
+    p[0] = h.kind;
+    p[1] = (uint8_t)(h.key);
+    p[2] = (uint8_t)(h.key >> 8);
+    p[3] = (uint8_t)(h.key >> 16);
+    p[4] = (uint8_t)(h.key >> 24);
+    p[5] = (uint8_t)h.nspLen;
+    p[6] = (uint8_t)h.evLen;
+    p[7] = (uint8_t)(h.payLen);
+    p[8] = (uint8_t)(h.payLen >> 8);
+  }
+
+  RecordHeader decodeHeader(const uint8_t *p)
+  {
+    RecordHeader h;
+    h.kind = p[0];
+    h.key = (uint32_t)p[1] | ((uint32_t)p[2] << 8) | ((uint32_t)p[3] << 16) | ((uint32_t)p[4] << 24);
+    h.nspLen = p[5];
+    h.evLen = p[6];
+    h.payLen = (size_t)p[7] | ((size_t)p[8] << 8);
+    return h;
+  }
+
+  uint32_t fnv1a(uint32_t h, const char *s)
+  {
+    while (*s)
+    {
+      h ^= (uint8_t)*s++;
+      h *= 16777619u;
+    }
+    return h;
+  }
+
+  uint32_t fnv1a(uint32_t h, const char *s, size_t len)
+  {
+    while (len--)
+    {
+      h ^= (uint8_t)*s++;
+      h *= 16777619u;
+    }
+    return h;
+  }
+
+  bool readHeaderAt(FILE *f, size_t offset, RecordHeader &h)
+  {
+    uint8_t buf[kHeaderSize];
+    if (fseek(f, (long)offset, SEEK_SET) != 0 || fread(buf, 1, kHeaderSize, f) != kHeaderSize)
+      return false;
+    h = decodeHeader(buf);
+    return h.kind == 'C' || h.kind == 'M' || h.kind == 'S';
+  }
+
+  // Namespace hash of the record whose header was just read from f.
+  uint32_t readNspHash(FILE *f, const RecordHeader &h)
+  {
+    char buf[64];
+    uint32_t hash = kFnvBasis;
+    for (size_t len = h.nspLen; len > 0;)
+    {
+      size_t n = len < sizeof(buf) ? len : sizeof(buf);
+      if (fread(buf, 1, n, f) != n)
+        break;
+      hash = fnv1a(hash, buf, n);
+      len -= n;
+    }
+    return hash;
+  }
+
+  bool readString(FILE *f, size_t len, String &out)
+  {
+    out = "";
+    out.reserve(len);
+    char buf[64];
+    while (len > 0)
+    {
+      size_t n = len < sizeof(buf) ? len : sizeof(buf);
+      if (fread(buf, 1, n, f) != n)
+        return false;
+      out.concat(buf, n);
+      len -= n;
+    }
+    return true;
+  }
+
+  bool copyBytes(FILE *in, FILE *out, size_t len)
+  {
+    uint8_t buf[64];
+    while (len > 0)
+    {
+      size_t n = len < sizeof(buf) ? len : sizeof(buf);
+      if (fread(buf, 1, n, in) != n || fwrite(buf, 1, n, out) != n)
+        return false;
+      len -= n;
+    }
+    return true;
+  }
+}
+
+bool OfflineJournal::begin(const char *path)
+{
+#ifdef ARDUINO
+  if (!LittleFS.begin(true))
+    return false;
+  _path = "/littlefs";
+  _path += path;
+#else
+  _path = path;
+#endif
+  _tmpPath = _path + ".tmp";
+  _fileBytes = 0;
+  _replayOffset = 0;
+  _cursor = 0;
+  _stageLen = 0;
+  FILE *f = fopen(_path.c_str(), "rb");
+  if (f)
+  {
+    // Resume whatever a previous run left behind.
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fclose(f);
+    _fileBytes = size > 0 ? (size_t)size : 0;
+  }
+  // Controls flushed separately before the restart are merged here, before
+  // anything is replayed.
+  if (_fileBytes > 0)
+    _compactFile();
+  else
+    _recount();
+  _enabled = true;
+  return true;
+}
+
+size_t OfflineJournal::records(const char *nsp) const
+{
+  uint32_t hash = fnv1a(kFnvBasis, nsp);
+  for (const NspRecords &r : _nspRecords)
+    if (r.count > 0 && r.hash == hash)
+      return r.count + _otherRecords;
+  return _otherRecords;
+}
+
+void OfflineJournal::_count(uint32_t nspHash, bool added)
+{
+  NspRecords *slot = nullptr;
+  for (NspRecords &r : _nspRecords)
+  {
+    if (r.count > 0 && r.hash == nspHash)
+    {
+      if (added)
+        r.count++;
+      else
+        r.count--;
+      return;
+    }
+    if (r.count == 0 && !slot)
+      slot = &r;
+  }
+  if (added && slot)
+  {
+    slot->hash = nspHash;
+    slot->count = 1;
+  }
+  else if (added)
+  {
+    _otherRecords++;
+  }
+  else if (_otherRecords > 0)
+  {
+    _otherRecords--;
+  }
+}
+
+// Rebuilds the per-namespace counts (and the number of records marked sent)
+// from the unsent part of the file and the stage.
+void OfflineJournal::_recount()
+{
+  for (NspRecords &r : _nspRecords)
+    r = NspRecords();
+  _otherRecords = 0;
+  _sentMarks = 0;
+  FILE *f = _fileBytes > _replayOffset ? fopen(_path.c_str(), "rb") : nullptr;
+  RecordHeader h;
+  for (size_t off = _replayOffset; f && off < _fileBytes && readHeaderAt(f, off, h); off += kHeaderSize + h.bodySize())
+  {
+    if (h.kind == 'S')
+      _sentMarks++;
+    else
+      _count(readNspHash(f, h), true);
+  }
+  if (f)
+    fclose(f);
+  for (size_t off = 0; off < _stageLen;)
+  {
+    RecordHeader s = decodeHeader(_stage + off);
+    _count(fnv1a(kFnvBasis, (const char *)_stage + off + kHeaderSize, s.nspLen), true);
+    off += kHeaderSize + s.bodySize();
+  }
+}
+
+bool OfflineJournal::append(const char *nsp, const char *event, const char *payload)
+{
+  if (!_enabled)
+    return false;
+  if (!payload || !*payload)
+    payload = "{}";
+  RecordHeader h;
+  h.kind = 'M';
+  h.nspLen = strlen(nsp);
+  h.evLen = strlen(event);
+  h.payLen = strlen(payload);
+  if (h.nspLen > 255 || h.evLen > 255 || h.payLen > 65535)
+    return false;
+  if (strcmp(event, "control") == 0)
+  {
+    StaticJsonDocument<ChBuffers::kEmitDocSize> doc;
+    if (!deserializeJson(doc, payload, h.payLen))
+    {
+      const char *header = doc["header"].as<const char *>();
+      if (header)
+      {
+        h.kind = 'C';
+        h.key = fnv1a(fnv1a(kFnvBasis, nsp), header);
+      }
+    }
+  }
+  if (h.kind == 'C')
+  {
+    // A newer value supersedes the staged one; the file copy is dropped at
+    // the next compaction.
+    for (size_t off = 0; off < _stageLen;)
+    {
+      RecordHeader s = decodeHeader(_stage + off);
+      size_t rs = kHeaderSize + s.bodySize();
+      if (s.kind == 'C' && s.key == h.key)
+      {
+        memmove(_stage + off, _stage + off + rs, _stageLen - off - rs);
+        _stageLen -= rs;
+        _count(fnv1a(kFnvBasis, nsp), false);
+        break;
+      }
+      off += rs;
+    }
+  }
+
+  size_t size = kHeaderSize + h.bodySize();
+  if (_stageLen + size > sizeof(_stage) && !flush())
+  {
+    _dropped++;
+    return false;
+  }
+  uint8_t hdr[kHeaderSize];
+  encodeHeader(hdr, h);
+  if (size > sizeof(_stage))
+  {
+    // Too large to stage: append straight to the file.
+    FILE *f = fopen(_path.c_str(), "ab");
+    if (!f)
+    {
+      _dropped++;
+      return false;
+    }
+    bool ok = fwrite(hdr, 1, kHeaderSize, f) == kHeaderSize &&
+              fwrite(nsp, 1, h.nspLen, f) == h.nspLen &&
+              fwrite(event, 1, h.evLen, f) == h.evLen &&
+              fwrite(payload, 1, h.payLen, f) == h.payLen;
+    fclose(f);
+    _fileBytes += size;
+    if (!ok)
+    {
+      _compactFile();
+      return false;
+    }
+    _count(fnv1a(kFnvBasis, nsp), true);
+    return true;
+  }
+  if (_stageLen == 0)
+    _firstStagedMs = millis();
+  uint8_t *p = _stage + _stageLen;
+  memcpy(p, hdr, kHeaderSize);
+  p += kHeaderSize;
+  memcpy(p, nsp, h.nspLen);
+  p += h.nspLen;
+  memcpy(p, event, h.evLen);
+  p += h.evLen;
+  memcpy(p, payload, h.payLen);
+  _stageLen += size;
+  _count(fnv1a(kFnvBasis, nsp), true);
+  return true;
+}
+
+void OfflineJournal::tick(uint32_t now)
+{
+  if (_stageLen > 0 && (uint32_t)(now - _firstStagedMs) >= JOURNAL_FLUSH_MS)
+    flush();
+}
+
+// Appends the RAM stage to the journal file in one write.
+bool OfflineJournal::flush()
+{
+  if (_stageLen == 0)
+    return true;
+  FILE *f = fopen(_path.c_str(), "ab");
+  if (!f)
+    return false;
+  size_t n = fwrite(_stage, 1, _stageLen, f);
+  fclose(f);
+  _fileBytes += n;
+  if (n != _stageLen)
+  {
+    _compactFile(); // drops the torn tail
+    return false;
+  }
+  _stageLen = 0;
+  if (_fileBytes > JOURNAL_MAX_BYTES)
+    _compactFile();
+  return true;
+}
+
+// Merges controls across earlier flushes before a replay: the stage goes to
+// the file and the file is compacted. Nothing is written unless the file
+// holds unsent records (the stage alone is already merged on append).
+bool OfflineJournal::compact()
+{
+  if (_fileBytes <= _replayOffset)
+    return true;
+  return flush() && _compactFile();
+}
+
+// Rewrites the unreplayed part of the file keeping only the last record per
+// control key and dropping records marked sent. If that is still above 3/4 of JOURNAL_MAX_BYTES, the oldest
+// records are dropped down to half, so compaction does not run on every flush.
+bool OfflineJournal::_compactFile()
+{
+  FILE *in = fopen(_path.c_str(), "rb");
+  if (!in)
+  {
+    _fileBytes = 0;
+    _replayOffset = 0;
+    _cursor = 0;
+    _recount();
+    return false;
+  }
+  struct LastControl
+  {
+    uint32_t key;
+    size_t offset;
+  };
+  LastControl last[JOURNAL_MAX_CONTROLS];
+  size_t keys = 0;
+  RecordHeader h;
+
+  // Pass 1: last offset of every control key; a torn tail ends the file.
+  size_t end = _replayOffset;
+  while (end < _fileBytes && readHeaderAt(in, end, h) && end + kHeaderSize + h.bodySize() <= _fileBytes)
+  {
+    if (h.kind == 'C')
+    {
+      size_t i = 0;
+      while (i < keys && last[i].key != h.key)
+        ++i;
+      if (i < keys)
+        last[i].offset = end;
+      else if (keys < JOURNAL_MAX_CONTROLS)
+        last[keys++] = {h.key, end};
+    }
+    end += kHeaderSize + h.bodySize();
+  }
+
+  auto kept = [&](size_t offset, const RecordHeader &r)
+  {
+    if (r.kind == 'S')
+      return false;
+    if (r.kind != 'C')
+      return true;
+    for (size_t i = 0; i < keys; ++i)
+      if (last[i].key == r.key)
+        return last[i].offset == offset;
+    return true; // untracked key (table full): keep
+  };
+
+  // Pass 2: size after compaction, and how much to drop from the front.
+  size_t keptBytes = 0;
+  for (size_t off = _replayOffset; off < end && readHeaderAt(in, off, h); off += kHeaderSize + h.bodySize())
+    if (kept(off, h))
+      keptBytes += kHeaderSize + h.bodySize();
+  size_t dropBytes = 0;
+  if (keptBytes > (size_t)JOURNAL_MAX_BYTES * 3 / 4)
+    dropBytes = keptBytes - JOURNAL_MAX_BYTES / 2;
+
+  // Pass 3: copy survivors.
+  FILE *out = fopen(_tmpPath.c_str(), "wb");
+  if (!out)
+  {
+    fclose(in);
+    return false;
+  }
+  size_t written = 0;
+  size_t skipped = 0;
+  bool ok = true;
+  for (size_t off = _replayOffset; ok && off < end && readHeaderAt(in, off, h); off += kHeaderSize + h.bodySize())
+  {
+    if (!kept(off, h))
+      continue;
+    size_t rs = kHeaderSize + h.bodySize();
+    if (skipped < dropBytes)
+    {
+      skipped += rs;
+      _dropped++;
+      continue;
+    }
+    ok = fseek(in, (long)off, SEEK_SET) == 0 && copyBytes(in, out, rs);
+    written += rs;
+  }
+  fclose(in);
+  fclose(out);
+  if (!ok)
+  {
+    remove(_tmpPath.c_str());
+    return false;
+  }
+  remove(_path.c_str());
+  if (written == 0)
+  {
+    remove(_tmpPath.c_str());
+  }
+  else if (rename(_tmpPath.c_str(), _path.c_str()) != 0)
+  {
+    written = 0;
+  }
+  _fileBytes = written;
+  _replayOffset = 0;
+  _cursor = 0;
+  _recount();
+  return true;
+}
+
+void OfflineJournal::rewind()
+{
+  _cursor = _replayOffset;
+  _peekSize = 0;
+}
+
+bool OfflineJournal::peek(String &nsp, String &event, String &payload)
+{
+  _peekSize = 0;
+  while (_cursor < _fileBytes)
+  {
+    FILE *f = fopen(_path.c_str(), "rb");
+    RecordHeader h;
+    bool ok = f && readHeaderAt(f, _cursor, h) && _cursor + kHeaderSize + h.bodySize() <= _fileBytes;
+    bool sent = ok && h.kind == 'S';
+    ok = ok && (sent || (readString(f, h.nspLen, nsp) && readString(f, h.evLen, event) && readString(f, h.payLen, payload)));
+    if (f)
+      fclose(f);
+    if (!ok)
+    {
+      // Corrupt or torn tail: nothing after it can be trusted. Keep the
+      // records before it, which the pass starts over with.
+      _fileBytes = _cursor;
+      if (!_compactFile())
+      {
+        remove(_path.c_str());
+        _fileBytes = 0;
+        _replayOffset = 0;
+        _cursor = 0;
+        _recount();
+      }
+      continue;
+    }
+    if (sent)
+    {
+      _cursor += kHeaderSize + h.bodySize();
+      continue;
+    }
+    _peekSize = kHeaderSize + h.bodySize();
+    _peekNspHash = fnv1a(kFnvBasis, nsp.c_str());
+    return true;
+  }
+  size_t off = _cursor - _fileBytes;
+  if (off >= _stageLen)
+    return false;
+  RecordHeader h = decodeHeader(_stage + off);
+  const char *p = (const char *)_stage + off + kHeaderSize;
+  nsp = "";
+  nsp.concat(p, h.nspLen);
+  p += h.nspLen;
+  event = "";
+  event.concat(p, h.evLen);
+  p += h.evLen;
+  payload = "";
+  payload.concat(p, h.payLen);
+  _peekSize = kHeaderSize + h.bodySize();
+  _peekNspHash = fnv1a(kFnvBasis, nsp.c_str());
+  return true;
+}
+
+void OfflineJournal::skip()
+{
+  _cursor += _peekSize;
+  _peekSize = 0;
+}
+
+// Past any records marked sent from offset on.
+size_t OfflineJournal::_skipSent(size_t offset)
+{
+  if (_sentMarks == 0 || offset >= _fileBytes)
+    return offset;
+  FILE *f = fopen(_path.c_str(), "rb");
+  RecordHeader h;
+  while (f && offset < _fileBytes && readHeaderAt(f, offset, h) && h.kind == 'S')
+  {
+    offset += kHeaderSize + h.bodySize();
+    _sentMarks--;
+  }
+  if (f)
+    fclose(f);
+  return offset;
+}
+
+void OfflineJournal::pop()
+{
+  if (_peekSize == 0)
+    return;
+  if (_cursor >= _fileBytes)
+  {
+    size_t off = _cursor - _fileBytes;
+    memmove(_stage + off, _stage + off + _peekSize, _stageLen - off - _peekSize);
+    _stageLen -= _peekSize;
+    _count(_peekNspHash, false);
+  }
+  else if (_cursor == _replayOffset)
+  {
+    _replayOffset = _skipSent(_replayOffset + _peekSize);
+    _cursor = _replayOffset;
+    _count(_peekNspHash, false);
+    if (_replayOffset >= _fileBytes)
+    {
+      remove(_path.c_str());
+      _fileBytes = 0;
+      _replayOffset = 0;
+      _cursor = 0;
+      _sentMarks = 0;
+    }
+  }
+  else
+  {
+    // Behind a record that is still waiting: mark it sent in place.
+    FILE *f = fopen(_path.c_str(), "r+b");
+    bool ok = f && fseek(f, (long)_cursor, SEEK_SET) == 0 && fputc('S', f) != EOF;
+    if (f)
+      fclose(f);
+    if (ok)
+    {
+      _sentMarks++;
+      _count(_peekNspHash, false);
+    }
+    _cursor += _peekSize;
+  }
+  _peekSize = 0;
+}
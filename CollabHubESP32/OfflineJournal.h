@@ -0,0 +1,79 @@
+#pragma once
+#include <Arduino.h>
+#include "BufferConfig.h"
+
+// Flash-side limits; override in config.h.
+#ifndef JOURNAL_MAX_BYTES
+#define JOURNAL_MAX_BYTES 16384 // journal file size before compaction/dropping
+#endif
+#ifndef JOURNAL_FLUSH_MS
+#define JOURNAL_FLUSH_MS 5000 // how long records may sit in RAM before a flash write
+#endif
+#ifndef JOURNAL_MAX_CONTROLS
+#define JOURNAL_MAX_CONTROLS 32 // distinct control headers tracked while compacting
+#endif
+
+// Bounded store-and-forward log for messages emitted while a namespace is
+// not open. Records are staged in RAM and appended to a file (LittleFS on the
+// device, a regular file on the host) at most every JOURNAL_FLUSH_MS, so a
+// stream of slider moves costs one flash write per interval.
+//
+// "control" messages are compacted to the last value per (namespace,
+// header); everything else is kept in order. The stage is merged on every
+// append, the file when it exceeds JOURNAL_MAX_BYTES, when begin() resumes
+// it after a restart, and on compact() before a replay. If the file is still
+// too large, the oldest records are dropped.
+//
+// Replay walks the records oldest first: rewind() starts a pass, peek()
+// returns the record at the cursor, pop() removes it and skip() leaves it
+// for a later pass (its namespace is not open yet). A record popped from
+// the middle of the file is marked sent in place and dropped by the next
+// compaction. records(nsp) counts the unsent records of one namespace.
+class OfflineJournal
+{
+public:
+  bool begin(const char *path);
+  bool enabled() const { return _enabled; }
+  bool pending() const { return _fileBytes > _replayOffset || _stageLen > 0; }
+  size_t records(const char *nsp) const;
+  bool append(const char *nsp, const char *event, const char *payload);
+  void tick(uint32_t now);
+  bool flush();
+  bool compact();
+
+  void rewind();
+  bool peek(String &nsp, String &event, String &payload);
+  void skip();
+  void pop();
+
+  uint32_t dropped() const { return _dropped; }
+  size_t fileBytes() const { return _fileBytes; }
+
+private:
+  struct NspRecords
+  {
+    uint32_t hash = 0;
+    size_t count = 0; // 0 = free
+  };
+
+  bool _compactFile();
+  void _recount();
+  void _count(uint32_t nspHash, bool added);
+  size_t _skipSent(size_t offset);
+
+  bool _enabled = false;
+  String _path;
+  String _tmpPath;
+  size_t _fileBytes = 0;
+  size_t _replayOffset = 0;
+  size_t _cursor = 0; // file offset, or _fileBytes + offset in the stage
+  size_t _peekSize = 0;
+  uint32_t _peekNspHash = 0;
+  size_t _sentMarks = 0; // records marked sent in the file
+  uint32_t _firstStagedMs = 0;
+  uint32_t _dropped = 0;
+  NspRecords _nspRecords[ChBuffers::kMaxNamespaces];
+  size_t _otherRecords = 0; // namespaces beyond _nspRecords
+  uint8_t _stage[ChBuffers::kJournalStageSize];
+  size_t _stageLen = 0;
+};
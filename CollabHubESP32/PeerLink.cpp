@@ -0,0 +1,388 @@
+#include "PeerLink.h"
+#include <ArduinoJson.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#ifdef ARDUINO
+#include <lwip/sockets.h>
+#include <lwip/inet.h>
+#else
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#endif
+
+namespace
+{
+  // Datagram: 'C' 'H' version type room[4] fromLen from
+  //           [headerLen header flags [at[4]] body]
+  const uint8_t kVersion = 2;
+  const uint8_t kTypeHello = 1;
+  const uint8_t kTypeControl = 2;
+  const uint8_t kTypeEvent = 3;
+  const uint8_t kFlagAt = 1;
+  const size_t kMaxPacket = ChBuffers::kPeerPacketSize;
+
+  uint32_t fnv1a(uint32_t h, const void *data, size_t len)
+  {
+    const uint8_t *p = (const uint8_t *)data;
+    for (size_t i = 0; i < len; ++i)
+    {
+      h ^= p[i];
+      h *= 16777619u;
+    }
+    return h;
+  }
+
+  void putU32(uint8_t *p, uint32_t v)
+  {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+  }
+
+  uint32_t getU32(const uint8_t *p)
+  {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+  }
+}
+
+bool PeerLink::begin(const char *room, const char *username, uint16_t port)
+{
+  _roomHash = fnv1a(2166136261u, room, strlen(room));
+  _port = port;
+  setUsername(username);
+  _enabled = true;
+  _open();
+  return true;
+}
+
+void PeerLink::setUsername(const char *username)
+{
+  _username = username ? username : "";
+}
+
+void PeerLink::end()
+{
+  if (_fd >= 0)
+    close(_fd);
+  _fd = -1;
+  _enabled = false;
+}
+
+// The socket is opened lazily so begin() can run before Wi-Fi is up.
+bool PeerLink::_open()
+{
+  if (_fd >= 0)
+    return true;
+  _lastOpenAttemptMs = millis();
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (fd < 0)
+    return false;
+  int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+#ifdef SO_REUSEPORT
+  setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+#endif
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(_port);
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  struct ip_mreq mreq;
+  memset(&mreq, 0, sizeof(mreq));
+  mreq.imr_multiaddr.s_addr = inet_addr(PEER_GROUP);
+  mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+  uint8_t ttl = 1;
+  uint8_t loop = 1; // lets several instances share one host
+  if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+      setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0)
+  {
+    close(fd);
+    return false;
+  }
+  setsockopt(fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+  setsockopt(fd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop));
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+  _fd = fd;
+  return true;
+}
+
+bool PeerLink::isPeer(const char *name) const
+{
+  if (!name || !*name)
+    return false;
+  for (size_t i = 0; i < ChBuffers::kMaxPeers; ++i)
+    if (_peers[i].name[0] && strcmp(_peers[i].name, name) == 0)
+      return true;
+  return false;
+}
+
+size_t PeerLink::peerCount() const
+{
+  size_t n = 0;
+  for (size_t i = 0; i < ChBuffers::kMaxPeers; ++i)
+    if (_peers[i].name[0])
+      n++;
+  return n;
+}
+
+bool PeerLink::_send(uint8_t type, const char *header, bool hasAt, uint32_t at, const uint8_t *body, size_t bodyLen)
+{
+  if (_fd < 0)
+    return false;
+  uint8_t buf[kMaxPacket];
+  size_t fromLen = _username.length();
+  size_t headerLen = header ? strlen(header) : 0;
+  size_t len = 8 + 1 + fromLen + (type == kTypeHello ? 0 : 1 + headerLen + 1 + (hasAt ? 4 : 0) + bodyLen);
+  if (fromLen > 255 || headerLen > 255 || len > sizeof(buf))
+    return false;
+  uint8_t *p = buf;
+  *p++ = 'C';
+  *p++ = 'H';
+  *p++ = kVersion;
+  *p++ = type;
+  putU32(p, _roomHash);
+  p += 4;
+  *p++ = (uint8_t)fromLen;
+  memcpy(p, _username.c_str(), fromLen);
+  p += fromLen;
+  if (type != kTypeHello)
+  {
+    *p++ = (uint8_t)headerLen;
+    memcpy(p, header, headerLen);
+    p += headerLen;
+    *p++ = hasAt ? kFlagAt : 0;
+    if (hasAt)
+    {
+      putU32(p, at);
+      p += 4;
+    }
+    memcpy(p, body, bodyLen);
+  }
+  struct sockaddr_in to;
+  memset(&to, 0, sizeof(to));
+  to.sin_family = AF_INET;
+  to.sin_port = htons(_port);
+  to.sin_addr.s_addr = inet_addr(PEER_GROUP);
+  if (sendto(_fd, buf, len, 0, (struct sockaddr *)&to, sizeof(to)) != (ssize_t)len)
+    return false;
+  if (type != kTypeHello)
+    _sent++;
+  return true;
+}
+
+bool PeerLink::sendControl(const char *header, float value, bool hasAt, uint32_t at)
+{
+  if (!_enabled || peerCount() == 0)
+    return false;
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  uint8_t body[4];
+  putU32(body, bits);
+  return _send(kTypeControl, header, hasAt, at, body, sizeof(body));
+}
+
+bool PeerLink::sendEvent(const char *header, const char *payload, bool hasAt, uint32_t at)
+{
+  if (!_enabled || peerCount() == 0)
+    return false;
+  size_t payLen = payload ? strlen(payload) : 0;
+  uint8_t body[kMaxPacket];
+  if (payLen + 2 > sizeof(body))
+    return false;
+  body[0] = (uint8_t)payLen;
+  body[1] = (uint8_t)(payLen >> 8);
+  memcpy(body + 2, payload, payLen);
+  return _send(kTypeEvent, header, hasAt, at, body, payLen + 2);
+}
+
+bool PeerLink::isDuplicate(Path path, const char *from, const char *header, float value, uint32_t now)
+{
+  if (!from || !header)
+    return false;
+  uint32_t key = fnv1a(2166136261u, from, strlen(from));
+  key = fnv1a(key, "\0", 1);
+  key = fnv1a(key, header, strlen(header));
+  key = fnv1a(key, &value, sizeof(value));
+  Seen *free = nullptr;
+  for (size_t i = 0; i < ChBuffers::kPeerDedupSlots; ++i)
+  {
+    Seen &s = _seen[i];
+    if (s.path != 0 && (uint32_t)(now - s.atMs) > PEER_DEDUP_MS)
+      s.path = 0;
+    if (s.path == 0)
+    {
+      if (!free)
+        free = &s;
+      continue;
+    }
+    if (s.key == key && s.path != path)
+    {
+      s.path = 0;
+      _duplicates++;
+      return true;
+    }
+  }
+  if (_deferPeer && (uint32_t)(now - _fullAtMs) > PEER_DEDUP_MS)
+    _deferPeer = false;
+  if (!free)
+  {
+    _dedupFull++;
+    _deferPeer = true;
+    _fullAtMs = now;
+  }
+  if (path == PathPeer && _deferPeer)
+  {
+    _deferred++;
+    return true;
+  }
+  if (!free)
+    return false;
+  free->key = key;
+  free->atMs = now;
+  free->path = path;
+  return false;
+}
+
+void PeerLink::_notePeer(const char *name, size_t len, uint32_t now)
+{
+  if (len == 0 || len >= sizeof(Peer::name))
+    return;
+  Peer *free = nullptr;
+  Peer *oldest = &_peers[0];
+  for (size_t i = 0; i < ChBuffers::kMaxPeers; ++i)
+  {
+    Peer &p = _peers[i];
+    if (p.name[0] && strlen(p.name) == len && memcmp(p.name, name, len) == 0)
+    {
+      p.lastSeenMs = now;
+      return;
+    }
+    if (!p.name[0] && !free)
+      free = &p;
+    if (p.lastSeenMs < oldest->lastSeenMs)
+      oldest = &p;
+  }
+  Peer &p = free ? *free : *oldest;
+  memcpy(p.name, name, len);
+  p.name[len] = 0;
+  p.lastSeenMs = now;
+}
+
+void PeerLink::poll(uint32_t now, const MessageHandler &onMessage)
+{
+  if (!_enabled)
+    return;
+  if (_fd < 0 && (uint32_t)(now - _lastOpenAttemptMs) >= PEER_HELLO_MS && !_open())
+    return;
+  if (_fd < 0)
+    return;
+  if ((uint32_t)(now - _lastHelloMs) >= PEER_HELLO_MS)
+  {
+    _lastHelloMs = now;
+    _send(kTypeHello, nullptr, false, 0, nullptr, 0);
+    for (size_t i = 0; i < ChBuffers::kMaxPeers; ++i)
+      if (_peers[i].name[0] && (uint32_t)(now - _peers[i].lastSeenMs) > 3 * PEER_HELLO_MS)
+        _peers[i].name[0] = 0;
+  }
+  uint8_t buf[kMaxPacket];
+  for (int i = 0; i < 16; ++i)
+  {
+    ssize_t n = recv(_fd, buf, sizeof(buf), 0);
+    if (n <= 0)
+      break;
+    _handlePacket(buf, (size_t)n, now, onMessage);
+  }
+}
+
+void PeerLink::_handlePacket(const uint8_t *buf, size_t len, uint32_t now, const MessageHandler &onMessage)
+{
+  if (len < 9 || buf[0] != 'C' || buf[1] != 'H' || buf[2] != kVersion || getU32(buf + 4) != _roomHash)
+    return;
+  uint8_t type = buf[3];
+  size_t fromLen = buf[8];
+  const uint8_t *p = buf + 9;
+  const uint8_t *end = buf + len;
+  if (p + fromLen > end)
+    return;
+  if (fromLen == _username.length() && memcmp(p, _username.c_str(), fromLen) == 0)
+    return; // our own multicast
+  _notePeer((const char *)p, fromLen, now);
+  if (type == kTypeHello)
+    return;
+
+  char from[32];
+  char header[64];
+  if (fromLen >= sizeof(from))
+    return;
+  memcpy(from, p, fromLen);
+  from[fromLen] = 0;
+  p += fromLen;
+  if (p >= end)
+    return;
+  size_t headerLen = *p++;
+  if (headerLen >= sizeof(header) || p + headerLen > end)
+    return;
+  memcpy(header, p, headerLen);
+  header[headerLen] = 0;
+  p += headerLen;
+  if (p >= end)
+    return;
+  uint8_t flags = *p++;
+  bool hasAt = flags & kFlagAt;
+  uint32_t at = 0;
+  if (hasAt)
+  {
+    if (p + 4 > end)
+      return;
+    at = getU32(p);
+    p += 4;
+  }
+
+  StaticJsonDocument<ChBuffers::kEmitDocSize> doc;
+  doc["header"] = header;
+  doc["from"] = from;
+  doc["mode"] = "push";
+  doc["target"] = "all";
+  if (hasAt)
+    doc["at"] = at;
+  const char *event;
+  float value = 0.0f;
+  if (type == kTypeControl)
+  {
+    if (p + 4 > end)
+      return;
+    uint32_t bits = getU32(p);
+    memcpy(&value, &bits, sizeof(value));
+    doc["values"] = value;
+    event = "control";
+  }
+  else if (type == kTypeEvent)
+  {
+    if (p + 2 > end)
+      return;
+    size_t payLen = (size_t)p[0] | ((size_t)p[1] << 8);
+    p += 2;
+    if (p + payLen > end)
+      return;
+    if (payLen > 0)
+    {
+      String payload;
+      payload.concat((const char *)p, payLen);
+      doc["payload"] = payload;
+    }
+    event = "event";
+  }
+  else
+  {
+    return;
+  }
+  _received++;
+  if (isDuplicate(PathPeer, from, header, value, now))
+    return;
+  String json;
+  serializeJson(doc, json);
+  onMessage(event, json.c_str(), json.length());
+}
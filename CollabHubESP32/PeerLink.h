@@ -0,0 +1,106 @@
+#pragma once
+#include <Arduino.h>
+#include <functional>
+#include "BufferConfig.h"
+
+// LAN settings; override in config.h.
+#ifndef PEER_GROUP
+#define PEER_GROUP "239.255.67.72" // site-local multicast group
+#endif
+#ifndef PEER_PORT
+#define PEER_PORT 4210
+#endif
+#ifndef PEER_HELLO_MS
+#define PEER_HELLO_MS 2000 // discovery beacon interval
+#endif
+#ifndef PEER_DEDUP_MS
+#define PEER_DEDUP_MS 3000 // how long to wait for the other path's copy
+#endif
+
+// Direct device-to-device path for control and event messages within one
+// room. Devices announce themselves with a multicast beacon. While at least
+// one peer is known, pushes to "all" are also sent as a compact binary
+// datagram to the group. The hub path stays the reliable fallback: every
+// message still goes through the hub, and whichever copy arrives second is
+// dropped by isDuplicate().
+//
+// Uses BSD sockets directly (lwIP on the device, POSIX on the host), so
+// several instances can run on one Linux host over loopback.
+class PeerLink
+{
+public:
+  // Decoded peer message, delivered in the hub's JSON shape.
+  using MessageHandler = std::function<void(const char *event, const char *json, size_t len)>;
+
+  enum Path : uint8_t
+  {
+    PathHub = 1,
+    PathPeer = 2
+  };
+
+  ~PeerLink() { end(); }
+  bool begin(const char *room, const char *username, uint16_t port = PEER_PORT);
+  void end();
+  bool enabled() const { return _enabled; }
+  void setUsername(const char *username);
+  void poll(uint32_t now, const MessageHandler &onMessage);
+
+  // hasAt/at carry the message's "at" shared time (see ClockSync), so the
+  // peer copy is delivered at the same moment as the hub copy would be.
+  bool sendControl(const char *header, float value, bool hasAt = false, uint32_t at = 0);
+  bool sendEvent(const char *header, const char *payload, bool hasAt = false, uint32_t at = 0);
+
+  // True if the same message already arrived via the other path; consumes
+  // that record. Otherwise remembers this copy and returns false. Records
+  // are kept for PEER_DEDUP_MS; when all slots are live the copy is not
+  // remembered (counted in dedupFull()) rather than evicting one. Its other
+  // copy could then not be matched, so for PEER_DEDUP_MS after that, peer
+  // copies that match nothing are also dropped (counted in deferred()) and
+  // the hub copy delivers them: a burst beyond the table costs latency, not
+  // double delivery.
+  bool isDuplicate(Path path, const char *from, const char *header, float value, uint32_t now);
+
+  bool isPeer(const char *name) const;
+  size_t peerCount() const;
+  uint32_t sent() const { return _sent; }
+  uint32_t received() const { return _received; }
+  uint32_t duplicates() const { return _duplicates; }
+  uint32_t dedupFull() const { return _dedupFull; }
+  uint32_t deferred() const { return _deferred; }
+
+private:
+  friend struct ClientSlotSizes;
+  struct Peer
+  {
+    char name[24] = {0};
+    uint32_t lastSeenMs = 0;
+  };
+  struct Seen
+  {
+    uint32_t key = 0;
+    uint32_t atMs = 0;
+    uint8_t path = 0; // 0 = free
+  };
+
+  bool _open();
+  bool _send(uint8_t type, const char *header, bool hasAt, uint32_t at, const uint8_t *body, size_t bodyLen);
+  void _handlePacket(const uint8_t *buf, size_t len, uint32_t now, const MessageHandler &onMessage);
+  void _notePeer(const char *name, size_t len, uint32_t now);
+
+  bool _enabled = false;
+  int _fd = -1;
+  uint16_t _port = PEER_PORT;
+  uint32_t _roomHash = 0;
+  String _username;
+  uint32_t _lastHelloMs = 0;
+  uint32_t _lastOpenAttemptMs = 0;
+  Peer _peers[ChBuffers::kMaxPeers];
+  Seen _seen[ChBuffers::kPeerDedupSlots];
+  uint32_t _sent = 0;
+  uint32_t _received = 0;
+  uint32_t _duplicates = 0;
+  uint32_t _dedupFull = 0;
+  uint32_t _deferred = 0;
+  bool _deferPeer = false;
+  uint32_t _fullAtMs = 0;
+};
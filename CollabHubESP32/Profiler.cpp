@@ -0,0 +1,115 @@
+#include "Profiler.h"
+
+#if CH_PROFILE
+
+Profiler::Record Profiler::_ring[CH_PROFILE_RING];
+size_t Profiler::_head = 0;
+size_t Profiler::_count = 0;
+
+uint32_t Profiler::_ticksPerUs()
+{
+#ifdef ARDUINO
+  return ESP.getCpuFreqMHz();
+#else
+  return 1000;
+#endif
+}
+
+namespace
+{
+  // Microseconds with three decimals, without going through float printing.
+  void printUs(Print &out, uint64_t ticks, uint32_t perUs)
+  {
+    out.print((unsigned long)(ticks / perUs));
+    unsigned long frac = (unsigned long)(ticks % perUs * 1000 / perUs);
+    out.print(frac < 10 ? ".00" : frac < 100 ? ".0" : ".");
+    out.print(frac);
+  }
+}
+
+// Records are stored in completion order, so nested scopes appear before
+// their parent; the start of each is unwrapped against the previous one
+// (valid while records are less than half a counter period apart: ~9 s at
+// 240 MHz). Timestamps are microseconds from the oldest record.
+void Profiler::exportChromeTrace(Print &out)
+{
+  uint32_t perUs = _ticksPerUs();
+  size_t n = _count;
+  int64_t t = 0;
+  int64_t minT = 0;
+  uint32_t prev = n ? _at(0).start : 0;
+  for (size_t i = 0; i < n; ++i)
+  {
+    t += (int32_t)(_at(i).start - prev);
+    prev = _at(i).start;
+    if (t < minT)
+      minT = t;
+  }
+
+  out.print("{\"traceEvents\":[");
+  t = 0;
+  prev = n ? _at(0).start : 0;
+  for (size_t i = 0; i < n; ++i)
+  {
+    const Record &r = _at(i);
+    t += (int32_t)(r.start - prev);
+    prev = r.start;
+    if (i)
+      out.print(",");
+    out.print("\n{\"name\":\"");
+    out.print(r.name);
+    out.print("\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":");
+    printUs(out, (uint64_t)(t - minT), perUs);
+    out.print(",\"dur\":");
+    printUs(out, r.ticks, perUs);
+    out.print("}");
+  }
+  out.println("\n]}");
+}
+
+// One line per marker name over the records in the ring: count, mean and
+// max duration in microseconds. Jitter shows up as max far above mean.
+void Profiler::printSummary(Print &out)
+{
+  const size_t kMaxNames = 24;
+  struct Stat
+  {
+    const char *name;
+    uint32_t count;
+    uint64_t total;
+    uint32_t max;
+  };
+  Stat stats[kMaxNames];
+  size_t names = 0;
+  for (size_t i = 0; i < _count; ++i)
+  {
+    const Record &r = _at(i);
+    size_t s = 0;
+    while (s < names && stats[s].name != r.name)
+      ++s;
+    if (s == names)
+    {
+      if (names == kMaxNames)
+        continue;
+      stats[names++] = {r.name, 0, 0, 0};
+    }
+    stats[s].count++;
+    stats[s].total += r.ticks;
+    if (r.ticks > stats[s].max)
+      stats[s].max = r.ticks;
+  }
+  uint32_t perUs = _ticksPerUs();
+  for (size_t s = 0; s < names; ++s)
+  {
+    out.print(stats[s].name);
+    out.print(" n=");
+    out.print((unsigned long)stats[s].count);
+    out.print(" mean=");
+    out.print((unsigned long)(stats[s].total / stats[s].count / perUs));
+    out.print("us max=");
+    out.print((unsigned long)(stats[s].max / perUs));
+    out.println("us");
+  }
+}
+
+#endif
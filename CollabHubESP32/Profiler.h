@@ -0,0 +1,87 @@
+#pragma once
+#include <Arduino.h>
+#include "config.h"
+#ifndef ARDUINO
+#include <chrono>
+#endif
+
+// Scoped loop profiler; off unless CH_PROFILE is set in config.h, in which
+// case CH_PROFILE_SCOPE("name") records how long the enclosing block took.
+// Names must be string literals. Records go into a fixed ring of
+// CH_PROFILE_RING entries (12 bytes each, not counted in the buffer budget)
+// and can be dumped as Chrome trace-event JSON (chrome://tracing, Perfetto)
+// or as a per-name count/mean/max summary.
+#ifndef CH_PROFILE
+#define CH_PROFILE 0
+#endif
+#ifndef CH_PROFILE_RING
+#define CH_PROFILE_RING 256
+#endif
+
+class Profiler
+{
+public:
+  struct Record
+  {
+    const char *name;
+    uint32_t start; // ticks
+    uint32_t ticks;
+  };
+
+  // Cycle counter on the device, steady clock (ns) on the host.
+  static inline uint32_t now()
+  {
+#ifdef ARDUINO
+    return ESP.getCycleCount();
+#else
+    return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+#endif
+  }
+
+  static inline void record(const char *name, uint32_t start, uint32_t end)
+  {
+    Record &r = _ring[_head];
+    r.name = name;
+    r.start = start;
+    r.ticks = end - start;
+    _head = (_head + 1) % CH_PROFILE_RING;
+    if (_count < CH_PROFILE_RING)
+      _count++;
+  }
+
+  static void exportChromeTrace(Print &out);
+  static void printSummary(Print &out);
+  static void clear() { _head = _count = 0; }
+
+private:
+  static uint32_t _ticksPerUs();
+  static const Record &_at(size_t i) { return _ring[(_head + CH_PROFILE_RING - _count + i) % CH_PROFILE_RING]; }
+
+  static Record _ring[CH_PROFILE_RING];
+  static size_t _head;
+  static size_t _count;
+};
+
+class ProfileScope
+{
+public:
+  explicit ProfileScope(const char *name) : _name(name), _start(Profiler::now()) {}
+  ~ProfileScope() { Profiler::record(_name, _start, Profiler::now()); }
+
+private:
+  const char *_name;
+  uint32_t _start;
+};
+
+#if CH_PROFILE
+#define CH_PROFILE_JOIN2(a, b) a##b
+#define CH_PROFILE_JOIN(a, b) CH_PROFILE_JOIN2(a, b)
+#define CH_PROFILE_SCOPE(name) ProfileScope CH_PROFILE_JOIN(_chProfile, __LINE__)(name)
+#else
+#define CH_PROFILE_SCOPE(name) \
+  do                           \
+  {                            \
+  } while (0)
+#endif
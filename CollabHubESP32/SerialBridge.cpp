@@ -0,0 +1,229 @@
+#include "SerialBridge.h"
+#include <string.h>
+
+namespace
+{
+  const uint8_t kEmit = 0x01;
+  const uint8_t kHello = 0x02;
+  const uint8_t kMessage = 0x81;
+  const uint8_t kCredit = 0x82;
+  const uint8_t kStatus = 0x83;
+  const uint8_t kWindow = 0x84;
+
+  uint8_t crc8(const uint8_t *p, size_t len)
+  {
+    uint8_t crc = 0;
+    while (len--)
+    {
+      crc ^= *p++;
+      for (int i = 0; i < 8; ++i)
+        crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+    }
+    return crc;
+  }
+
+  // In-place COBS decode; returns decoded length or 0 on malformed input.
+  size_t cobsDecode(uint8_t *buf, size_t len)
+  {
+    size_t in = 0;
+    size_t out = 0;
+    while (in < len)
+    {
+      uint8_t code = buf[in++];
+      if (code == 0 || in + code - 1 > len)
+        return 0;
+      for (uint8_t i = 1; i < code; ++i)
+        buf[out++] = buf[in++];
+      if (code < 0xFF && in < len)
+        buf[out++] = 0;
+    }
+    return out;
+  }
+}
+
+void SerialBridge::begin(Stream &port, EmitHandler onEmit)
+{
+  _port = &port;
+  _onEmit = onEmit;
+  _rxLen = 0;
+  _rxOverflow = false;
+}
+
+// Reads whatever is buffered, dispatches complete packets and returns the
+// consumed ones to the host as credits. Every frame that ends at a delimiter
+// uses up one of the host's credits, so a rejected one (bad CRC, malformed,
+// too long) is returned too; only HELLO, which resets the window, is not. A
+// change in hub connection state is reported with a STATUS packet.
+void SerialBridge::poll(bool connected)
+{
+  if (!_port)
+    return;
+  if (_lastConnected != (int)connected)
+  {
+    _lastConnected = connected;
+    sendStatus(connected);
+  }
+  int avail = _port->available();
+  while (avail-- > 0)
+  {
+    int c = _port->read();
+    if (c < 0)
+      break;
+    if (c != 0)
+    {
+      if (_rxLen < sizeof(_rx))
+        _rx[_rxLen++] = (uint8_t)c;
+      else
+        _rxOverflow = true;
+      continue;
+    }
+    if (_rxLen == 0)
+      continue; // the leading delimiter of the next frame
+    size_t n = _rxOverflow ? 0 : cobsDecode(_rx, _rxLen);
+    if (n >= 2 && crc8(_rx, n - 1) == _rx[n - 1])
+    {
+      _handlePacket(_rx, n - 1, connected);
+    }
+    else
+    {
+      _rejected++;
+      _returnCredit();
+    }
+    _rxLen = 0;
+    _rxOverflow = false;
+  }
+  if (_pendingCredits > 0)
+  {
+    uint8_t pkt[2] = {kCredit, _pendingCredits};
+    if (_writePacket(pkt, sizeof(pkt)))
+      _pendingCredits = 0;
+  }
+}
+
+void SerialBridge::_handlePacket(uint8_t *buf, size_t len, bool connected)
+{
+  if (buf[0] == kHello)
+  {
+    // The window covers every frame before this one.
+    _pendingCredits = 0;
+    uint8_t pkt[2] = {kWindow, SERIAL_BRIDGE_WINDOW};
+    _writePacket(pkt, sizeof(pkt));
+    sendStatus(connected);
+    return;
+  }
+  _returnCredit();
+  if (buf[0] != kEmit || len < 3)
+  {
+    _rejected++;
+    return;
+  }
+  // Strings are NUL-terminated in place; the packet buffer has one spare
+  // byte so the payload can be terminated too.
+  size_t nspLen = buf[1];
+  size_t evOff = 2 + nspLen;
+  if (evOff >= len)
+  {
+    _rejected++;
+    return;
+  }
+  size_t evLen = buf[evOff];
+  size_t payOff = evOff + 1 + evLen;
+  if (payOff > len || evLen == 0)
+  {
+    _rejected++;
+    return;
+  }
+  char nsp[64];
+  char event[64];
+  if (nspLen >= sizeof(nsp) || evLen >= sizeof(event))
+  {
+    _rejected++;
+    return;
+  }
+  memcpy(nsp, buf + 2, nspLen);
+  nsp[nspLen] = 0;
+  memcpy(event, buf + evOff + 1, evLen);
+  event[evLen] = 0;
+  buf[len] = 0;
+  if (_onEmit)
+    _onEmit(nspLen ? nsp : nullptr, event, (const char *)buf + payOff);
+}
+
+void SerialBridge::_returnCredit()
+{
+  if (_pendingCredits < 255)
+    _pendingCredits++;
+}
+
+// COBS-encodes buf plus its CRC between two 0x00 delimiters and writes it in
+// one call, or drops it if the TX buffer cannot take the whole frame. The
+// leading 0x00 ends any text printed since the last frame, so the text is
+// discarded on its own instead of corrupting this packet.
+bool SerialBridge::_writePacket(const uint8_t *buf, size_t len)
+{
+  if (!_port || len + 1 > SERIAL_BRIDGE_PACKET_SIZE)
+    return false;
+  uint8_t out[SERIAL_BRIDGE_FRAME_SIZE];
+  uint8_t crc = crc8(buf, len);
+  out[0] = 0;
+  size_t codeIdx = 1;
+  size_t o = 2;
+  uint8_t code = 1;
+  for (size_t i = 0; i <= len; ++i)
+  {
+    uint8_t b = (i < len) ? buf[i] : crc;
+    if (b == 0)
+    {
+      out[codeIdx] = code;
+      codeIdx = o++;
+      code = 1;
+      continue;
+    }
+    out[o++] = b;
+    if (++code == 0xFF)
+    {
+      out[codeIdx] = code;
+      codeIdx = o++;
+      code = 1;
+    }
+  }
+  out[codeIdx] = code;
+  out[o++] = 0;
+  if (_port->availableForWrite() < (int)o)
+  {
+    _dropped++;
+    return false;
+  }
+  return _port->write(out, o) == o;
+}
+
+bool SerialBridge::sendMessage(const char *nsp, const char *event, const char *json, size_t len)
+{
+  uint8_t pkt[SERIAL_BRIDGE_PACKET_SIZE];
+  size_t nspLen = nsp ? strlen(nsp) : 0;
+  size_t evLen = strlen(event);
+  size_t total = 3 + nspLen + evLen + len;
+  if (nspLen > 255 || evLen > 255 || total + 1 > sizeof(pkt))
+  {
+    _dropped++;
+    return false;
+  }
+  uint8_t *p = pkt;
+  *p++ = kMessage;
+  *p++ = (uint8_t)nspLen;
+  if (nspLen)
+    memcpy(p, nsp, nspLen);
+  p += nspLen;
+  *p++ = (uint8_t)evLen;
+  memcpy(p, event, evLen);
+  p += evLen;
+  memcpy(p, json, len);
+  return _writePacket(pkt, total);
+}
+
+void SerialBridge::sendStatus(bool connected)
+{
+  uint8_t pkt[6] = {kStatus, (uint8_t)(connected ? 1 : 0),
+                    (uint8_t)_dropped, (uint8_t)(_dropped >> 8), (uint8_t)(_dropped >> 16), (uint8_t)(_dropped >> 24)};
+  _writePacket(pkt, sizeof(pkt));
+}
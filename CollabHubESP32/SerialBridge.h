@@ -0,0 +1,59 @@
+#pragma once
+#include <Arduino.h>
+#include <functional>
+#include "BufferConfig.h" // SERIAL_BRIDGE_PACKET_SIZE, SERIAL_BRIDGE_WINDOW
+
+// Binary gateway between a computer on the USB serial port and SioClient.
+//
+// Framing: each packet is COBS-encoded and sent between two 0x00 bytes, so
+// the receiver resynchronises on the next zero after any noise, and text
+// written to the port between packets ends up in a frame of its own that
+// fails the check. The last byte of every decoded packet is a CRC-8
+// (poly 0x07) of the rest.
+//
+// Host -> device
+//   0x01 EMIT    nspLen nsp evLen event payload...   -> SioClient::emit
+//   0x02 HELLO   (no body)                           -> WINDOW + STATUS
+// Device -> host
+//   0x81 MESSAGE nspLen nsp evLen event payload...   inbound hub message
+//   0x82 CREDIT  count                               host may send count more
+//   0x83 STATUS  connected dropped[4]                link state
+//   0x84 WINDOW  count                               host may send count, in
+//                                                    place of any credits held
+//
+// Packets are at most SERIAL_BRIDGE_PACKET_SIZE bytes including the CRC.
+//
+// Flow control: the host keeps at most SERIAL_BRIDGE_WINDOW packets in flight
+// and gets one credit back for each frame the device reads, valid or not.
+// Only the WINDOW answer to HELLO resets the count; STATUS, also sent on its
+// own when the hub connection changes, never touches it. A host that hears
+// nothing back after HELLO sends it again. Outbound packets
+// that do not fit in the serial TX buffer are dropped and counted instead of
+// blocking loop(). Nothing on this path formats text.
+class SerialBridge
+{
+public:
+  using EmitHandler = std::function<void(const char *nsp, const char *event, const char *payloadJson)>;
+
+  void begin(Stream &port, EmitHandler onEmit);
+  void poll(bool connected);
+  bool sendMessage(const char *nsp, const char *event, const char *json, size_t len);
+  void sendStatus(bool connected);
+  uint32_t dropped() const { return _dropped; }
+  uint32_t rejected() const { return _rejected; }
+
+private:
+  void _handlePacket(uint8_t *buf, size_t len, bool connected);
+  bool _writePacket(const uint8_t *buf, size_t len);
+  void _returnCredit();
+
+  Stream *_port = nullptr;
+  EmitHandler _onEmit = nullptr;
+  uint8_t _rx[SERIAL_BRIDGE_FRAME_SIZE - 2]; // one encoded packet, without delimiters
+  size_t _rxLen = 0;
+  bool _rxOverflow = false;
+  uint8_t _pendingCredits = 0;
+  int _lastConnected = -1;
+  uint32_t _dropped = 0;
+  uint32_t _rejected = 0;
+};
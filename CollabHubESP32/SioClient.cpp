@@ -1,4 +1,5 @@
 #include "SioClient.h"
+#include "Profiler.h"
 #include <ArduinoJson.h>
 #include <cstring>
 #include <string>
@@ -11,38 +12,355 @@ bool SioClient::connected()
 #include <cstring>
 #include <string>
 
-SioClient::SioClient() {}
+// Collab-Hub sends "values" either as a number or as an array of numbers.
+static float _controlValue(JsonVariant values)
+{
+  return values.is<JsonArray>() ? values[0].as<float>() : values.as<float>();
+}
+
+SioClient::SioClient()
+{
+  _namespaces[0].name = "/";
+}
 
 void SioClient::begin(const char *host, uint16_t port, const char *nsp, bool useSSL, const char *username)
 {
-  (void)useSSL; // USE_TLS is compile-time.
-  _nsp = (nsp && *nsp) ? String(nsp) : String("/");
+  _namespaces[0].name = (nsp && *nsp) ? String(nsp) : String("/");
+  _mergeDefaultNamespace();
+  _closeNamespaces();
   _username = (username && *username) ? String(username) : String("");
-  String path = "/socket.io/?EIO=4&transport=websocket";
+  _path = "/socket.io/?EIO=4&transport=websocket";
   if (_username.length() > 0)
   {
-    path += "&username=";
-    path += _username;
+    _path += "&username=";
+    _path += _username;
   }
-  // Serial.print("WS connecting to ");
-  // Serial.print(host);
-  // Serial.print(":");
-  // Serial.print(port);
-  // Serial.print(" path ");
-  // Serial.println(path);
-  bool ok = _ws.connect(host, port, path.c_str());
+  if (host && *host)
+    addEndpoint(host, port, useSSL);
+  if (_username.length() > 0)
+    _peerLink.setUsername(_username.c_str());
+  // Serial.print("WS connecting, path ");
+  // Serial.println(_path);
+  bool ok = _connectBest();
   if (!ok)
   {
     // Serial.println("WS connect failed (TCP)");
   }
 }
 
-void SioClient::loop()
+// Adds a hub to race against on (re)connect, e.g. an on-site LAN hub next to
+// the cloud hub. Re-adding an existing host/port just updates its scheme.
+bool SioClient::addEndpoint(const char *host, uint16_t port, bool useTls)
+{
+  for (size_t i = 0; i < _endpointCount; ++i)
+  {
+    if (_endpoints[i].port == port && _endpoints[i].host == host)
+    {
+      _endpoints[i].useTls = useTls;
+      return true;
+    }
+  }
+  if (_endpointCount >= EndpointRace::kMaxEndpoints)
+    return false;
+  HubEndpoint &ep = _endpoints[_endpointCount++];
+  ep.host = host;
+  ep.port = port;
+  ep.useTls = useTls;
+  return true;
+}
+
+// With several endpoints, races TCP connects to all of them and tries the
+// WebSocket handshake in order of measured connect time; unreachable
+// endpoints are tried last in the order they were added.
+bool SioClient::_connectBest()
+{
+  _activeEndpoint = -1;
+  _connectCount = 0;
+  _connectIndex = 0;
+  if (_endpointCount == 0)
+    return false;
+  if (_endpointCount == 1)
+  {
+    _connectOrder[_connectCount++] = 0;
+    return _connectNext();
+  }
+
+  _race.run(_endpoints, _endpointCount, SIO_RACE_TIMEOUT_MS);
+  _lastProbeMs = millis();
+  uint8_t *order = _connectOrder;
+  size_t n = 0;
+  for (size_t i = 0; i < _endpointCount; ++i)
+    if (_endpoints[i].reachable)
+      order[n++] = i;
+  for (size_t i = 1; i < n; ++i)
+  {
+    uint8_t k = order[i];
+    size_t j = i;
+    for (; j > 0 && _endpoints[order[j - 1]].rttMs > _endpoints[k].rttMs; --j)
+      order[j] = order[j - 1];
+    order[j] = k;
+  }
+  for (size_t i = 0; i < _endpointCount; ++i)
+    if (!_endpoints[i].reachable)
+      order[n++] = i;
+  _connectCount = n;
+  return _connectNext();
+}
+
+// Tries the endpoints left in _connectOrder until one connects. With
+// SIO_ASYNC_CONNECT that only means its upgrade has started; loop() comes
+// back here if it fails.
+bool SioClient::_connectNext()
+{
+  while (_connectIndex < _connectCount)
+  {
+    if (_connectTo(_connectOrder[_connectIndex++]))
+      return true;
+  }
+  return false;
+}
+
+bool SioClient::_connectTo(size_t index)
+{
+  const HubEndpoint &ep = _endpoints[index];
+#if SIO_ASYNC_CONNECT
+  if (!_ws.startConnect(ep.host.c_str(), ep.port, _path.c_str(), ep.useTls))
+    return false;
+  _connecting = true;
+#else
+  if (!_ws.connect(ep.host.c_str(), ep.port, _path.c_str(), ep.useTls))
+    return false;
+#endif
+  _activeEndpoint = (int)index;
+  _activeProbeFailures = 0;
+  return true;
+}
+
+// Stores emits made while offline in a journal file (LittleFS on the device)
+// and replays them after the namespace open ack. Call before begin().
+bool SioClient::enableJournal(const char *path)
+{
+  return _journal.begin(path);
+}
+
+// Keeps the latest value of every control received in the default
+// namespace, looked up by header through controls(). Allocates the table
+// once.
+bool SioClient::enableControlCache()
+{
+  return _controls.begin(ChBuffers::kControlCacheSize);
+}
+
+// Starts estimating the hub clock. event is emitted with an ack; the server
+// must answer with its time in ms since the epoch, either as a number or as
+// {"time": ms}. Once synced, received messages carrying an "at" shared time
+// (ClockSync::sharedMs()) are delivered at that time instead of on arrival.
+void SioClient::enableClockSync(const char *event)
+{
+  _clockEvent = event;
+}
+
+void SioClient::_syncClock(uint32_t now)
+{
+  CH_PROFILE_SCOPE("clock");
+  _clock.tick();
+  if (!isOpen() || !_clock.due(now))
+    return;
+  uint64_t t0 = _clock.localUs();
+  emitWithAck(nullptr, _clockEvent.c_str(), "{}", [this, t0](const char *json, size_t len)
+              {
+                uint64_t t3 = _clock.localUs();
+                StaticJsonDocument<ChBuffers::kOpenDocSize> doc;
+                if (deserializeJson(doc, json, len))
+                  return;
+                JsonVariant v = doc[0];
+                double serverMs = v.is<JsonObject>() ? v["time"].as<double>() : v.as<double>();
+                if (serverMs > 0)
+                  _clock.addSample(t0, (int64_t)serverMs, t3); });
+}
+
+// Sends pushes to "all" in the default namespace directly to devices in the
+// same room on the LAN as well as through the hub; receivers drop whichever
+// copy arrives second. Call after the username is known (before begin()).
+bool SioClient::enablePeers(const char *room)
 {
-  _ws.poll([this](const char *data, size_t len)
-           { _handleText(data, len); });
+  return _peerLink.begin(room, _username.c_str());
+}
+
+void SioClient::_sendToPeers(const char *event, const char *payloadJson)
+{
+  bool isControl = strcmp(event, "control") == 0;
+  if ((!isControl && strcmp(event, "event") != 0) || !payloadJson || _peerLink.peerCount() == 0)
+    return;
+  StaticJsonDocument<ChBuffers::kEmitDocSize> doc;
+  if (deserializeJson(doc, payloadJson))
+    return;
+  const char *target = doc["target"] | "all";
+  const char *header = doc["header"].as<const char *>();
+  if (!header || strcmp(target, "all") != 0)
+    return;
+  JsonVariant at = doc["at"];
+  bool hasAt = at.is<uint32_t>();
+  if (isControl)
+    _peerLink.sendControl(header, _controlValue(doc["values"]), hasAt, at.as<uint32_t>());
+  else
+    _peerLink.sendEvent(header, doc["payload"].as<const char *>(), hasAt, at.as<uint32_t>());
+}
+
+// A peer datagram, already in the hub's JSON shape: handled exactly like the
+// hub copy would be, including a scheduled "at" time.
+void SioClient::_dispatchPeerMessage(const char *event, const char *json, size_t len)
+{
+  Namespace &ns = _namespaces[0];
+  StaticJsonDocument<ChBuffers::kEmitDocSize> doc;
+  if (deserializeJson(doc, json, len))
+    return;
+  if (_controls.enabled() && strcmp(event, "control") == 0)
+    _controls.update(doc["header"].as<const char *>(), _controlValue(doc["values"]),
+                     doc["from"].as<const char *>(), millis());
+  auto it = ns.handlers.find(std::string(event));
+  if (it != ns.handlers.end())
+    _deliver(it->second, json, len, doc["at"]);
+}
+
+// Runs handler now, or at the message's "at" shared time once the clock is
+// synced.
+void SioClient::_deliver(const TextHandler &handler, const char *json, size_t len, JsonVariant at)
+{
+  if (_clock.synced() && at.is<uint32_t>())
+  {
+    _clock.schedule(at.as<uint32_t>(), handler, json, len);
+    return;
+  }
+  CH_PROFILE_SCOPE("handler");
+  handler(json, len);
+}
+
+// Sends up to SIO_JOURNAL_REPLAY_BATCH journaled messages per
+// SIO_JOURNAL_REPLAY_INTERVAL_MS, oldest first, plus one for every live
+// emit that was queued behind them since the last round, so the backlog
+// shrinks however fast the script emits. Each message is removed only once
+// it was written. A message whose namespace is not open (or whose write
+// failed) stays, and so does everything after it in that namespace, but the
+// other namespaces' messages are still sent: one namespace that never opens
+// does not hold up the rest.
+void SioClient::_replayJournal(uint32_t now)
+{
+  if (!_journal.pending() || (uint32_t)(now - _lastReplayMs) < SIO_JOURNAL_REPLAY_INTERVAL_MS)
+    return;
+  _lastReplayMs = now;
+  bool sendable = false;
+  for (size_t i = 0; i < _namespaceCount && !sendable; ++i)
+    sendable = isOpen(_namespaces[i].name.c_str()) && _journal.records(_namespaces[i].name.c_str()) > 0;
+  if (!sendable)
+    return;
+  size_t limit = SIO_JOURNAL_REPLAY_BATCH + _journalLive;
+  _journalLive = 0;
+  bool held[ChBuffers::kMaxNamespaces] = {};
+  size_t heldCount = 0;
+  String nsp, event, payload;
+  _journal.rewind();
+  for (size_t sent = 0; sent < limit && heldCount < _namespaceCount && _journal.peek(nsp, event, payload);)
+  {
+    Namespace *ns = _findNamespace(nsp.c_str());
+    if (!ns)
+    {
+      _journal.pop(); // namespace no longer registered
+      continue;
+    }
+    size_t i = ns - _namespaces;
+    if (!held[i] && isOpen(nsp.c_str()) && _sendEvent(nsp.c_str(), event.c_str(), payload.c_str()))
+    {
+      _journal.pop();
+      sent++;
+      continue;
+    }
+    if (!held[i])
+    {
+      held[i] = true;
+      heldCount++;
+    }
+    _journal.skip();
+  }
+}
+
+// Background re-probe while connected: if another endpoint now answers
+// SIO_SWITCH_MARGIN_MS faster than the active one (e.g. the LAN hub came
+// back), move the session over to it. Probes use the addresses resolved on
+// the last connect, so this never waits on DNS.
+void SioClient::_reprobe(uint32_t now)
+{
+  if (_endpointCount < 2 || _activeEndpoint < 0)
+    return;
+  CH_PROFILE_SCOPE("reprobe");
+  if (!_race.active())
+  {
+    if (now - _lastProbeMs >= SIO_REPROBE_INTERVAL_MS)
+    {
+      _lastProbeMs = now;
+      _race.start(_endpoints, _endpointCount, SIO_RACE_TIMEOUT_MS);
+    }
+    return;
+  }
+  if (!_race.poll())
+    return;
+  const HubEndpoint &cur = _endpoints[_activeEndpoint];
+  _activeProbeFailures = cur.reachable ? 0 : _activeProbeFailures + 1;
+  int best = -1;
+  for (size_t i = 0; i < _endpointCount; ++i)
+  {
+    if ((int)i == _activeEndpoint || !_endpoints[i].reachable)
+      continue;
+    if (best < 0 || _endpoints[i].rttMs < _endpoints[best].rttMs)
+      best = (int)i;
+  }
+  if (best < 0)
+    return;
+  // poll() runs once per loop(), so each time is only known to within a
+  // loop period: switch only if the other endpoint wins even then. A probe
+  // of the active hub can fail while its session is fine, so leave it only
+  // after SIO_PROBE_FAILURES failed probes in a row.
+  if (cur.reachable ? _endpoints[best].rttMs + SIO_SWITCH_MARGIN_MS >= cur.rttMinMs
+                    : _activeProbeFailures < SIO_PROBE_FAILURES)
+    return;
+  // Serial.println("[SioClient] Switching to faster endpoint");
+  int previous = _activeEndpoint;
+  _ws.disconnect();
+  _closeNamespaces();
+  _lastPingMs = 0;
+  _connectOrder[0] = (uint8_t)best;
+  _connectOrder[1] = (uint8_t)previous;
+  _connectCount = 2;
+  _connectIndex = 0;
+  _connectNext();
+}
+
+// Dispatches up to _pollMaxFrames inbound frames or until _pollBudgetUs has
+// elapsed, whichever comes first. Returns the number of frames dispatched.
+size_t SioClient::loop()
+{
+  CH_PROFILE_SCOPE("sio.loop");
+  size_t frames = _ws.poll([this](const char *data, size_t len)
+                           { _handleText(data, len); },
+                           _pollMaxFrames, _pollBudgetUs);
+  if (_connecting && !_ws.upgrading())
+  {
+    _connecting = false;
+    if (!_ws.connected())
+    {
+      // The upgrade failed: on to the next endpoint in line.
+      _activeEndpoint = -1;
+      _connectNext();
+    }
+  }
 
   uint32_t now = millis();
+  if (_peerLink.enabled())
+  {
+    CH_PROFILE_SCOPE("peer.poll");
+    _peerLink.poll(now, [this](const char *event, const char *json, size_t len)
+                   { _dispatchPeerMessage(event, json, len); });
+  }
   // Print current connection status and ping interval
   static bool lastConnected = true;
   bool currentConnected = connected();
@@ -61,43 +379,251 @@ void SioClient::loop()
     {
       // Serial.println("[SioClient] Ping timeout, disconnecting");
       _ws.disconnect();
-      _open = false;
+      _closeNamespaces();
       _lastPingMs = 0;
-      return;
+      return frames;
     }
   }
 
+  if (_journal.enabled())
+  {
+    CH_PROFILE_SCOPE("journal");
+    _journal.tick(now);
+    _replayJournal(now);
+  }
+
+  if (_clockEvent.length() > 0)
+    _syncClock(now);
+
+  if (_engineOpen)
+    _reprobe(now);
+
   // Do NOT send client-initiated pings. Only respond to server pings.
+  return frames;
+}
+
+void SioClient::setPollBudget(size_t maxFrames, uint32_t budgetUs)
+{
+  _pollMaxFrames = maxFrames > 0 ? maxFrames : 1;
+  _pollBudgetUs = budgetUs;
+}
+
+// Inbound bytes still buffered after the last loop(); non-zero means the
+// drain limit was hit and more frames are waiting.
+size_t SioClient::pendingBytes()
+{
+  return _ws.pendingBytes();
 }
 
 void SioClient::emit(const char *event, const char *payloadJson)
+{
+  emit(_namespaces[0].name.c_str(), event, payloadJson);
+}
+
+// While the namespace is not open, or older journaled messages for it are
+// still waiting to be replayed, emits go to the journal so nothing is lost
+// and order is kept. The open handler bypasses it: its handshake emits
+// (addUsername, joinRoom, ...) must reach the hub before the replay.
+void SioClient::emit(const char *nsp, const char *event, const char *payloadJson)
+{
+  if (!nsp)
+    nsp = _namespaces[0].name.c_str();
+  if (_peerLink.enabled() && _namespaces[0].name == nsp)
+    _sendToPeers(event, payloadJson);
+  if (_journal.enabled() && !_journalBypass && (!isOpen(nsp) || _journal.records(nsp) > 0))
+  {
+    if (_journal.append(nsp, event, payloadJson) && isOpen(nsp))
+      _journalLive++;
+    return;
+  }
+  _sendEvent(nsp, event, payloadJson);
+}
+
+bool SioClient::_sendEvent(const char *nsp, const char *event, const char *payloadJson, uint32_t ackId)
 {
   String frame = "42";
-  if (_nsp.length() > 1)
+  if (nsp && strcmp(nsp, "/") != 0)
   {
-    frame += _nsp;
+    frame += nsp;
     frame += ",";
   }
+  if (ackId)
+    frame += String(ackId);
   frame += "[\"";
   frame += event;
   frame += "\",";
   frame += (payloadJson && *payloadJson) ? payloadJson : "{}";
   frame += "]";
-  _ws.sendText(frame.c_str(), frame.length());
+  return _ws.sendText(frame.c_str(), frame.length());
+}
+
+// Emits with a Socket.IO ack id; onAck receives the server's reply arguments
+// as a JSON array. Not journaled: fails if the namespace is not open. When
+// all ack slots are busy the oldest request is abandoned.
+bool SioClient::emitWithAck(const char *nsp, const char *event, const char *payloadJson, TextHandler onAck)
+{
+  if (!nsp)
+    nsp = _namespaces[0].name.c_str();
+  Namespace *ns = _findNamespace(nsp);
+  if (!ns || !isOpen(nsp))
+    return false;
+  PendingAck *slot = &_acks[0];
+  for (size_t i = 0; i < ChBuffers::kMaxPendingAcks; ++i)
+  {
+    if (_acks[i].id == 0 || _acks[i].id < slot->id)
+      slot = &_acks[i];
+    if (_acks[i].id == 0)
+      break;
+  }
+  uint32_t id = _nextAckId++;
+  if (_nextAckId == 0)
+    _nextAckId = 1;
+  slot->id = id;
+  slot->ns = ns;
+  slot->handler = onAck;
+  if (!_sendEvent(nsp, event, payloadJson, id))
+  {
+    slot->id = 0;
+    slot->handler = nullptr;
+    return false;
+  }
+  return true;
+}
+
+// Emits between beginBatch() and flush() are packed into a single write.
+void SioClient::beginBatch()
+{
+  _ws.beginBatch();
+}
+
+bool SioClient::flush()
+{
+  return _ws.flush();
+}
+
+void SioClient::setNoDelay(bool noDelay)
+{
+  _ws.setNoDelay(noDelay);
 }
 
 void SioClient::on(const char *event, TextHandler handler)
 {
-  _handlers[std::string(event)] = handler;
+  _namespaces[0].handlers[std::string(event)] = handler;
 }
 
 void SioClient::onOpen(OpenHandler handler)
 {
-  _openHandler = handler;
+  _namespaces[0].openHandler = handler;
+}
+
+// Registers an additional namespace on the shared connection. If the
+// Engine.IO session is already up the namespace is opened immediately,
+// otherwise it is opened together with the others on the next handshake.
+bool SioClient::addNamespace(const char *nsp)
+{
+  if (!nsp || *nsp != '/')
+    return false;
+  if (_findNamespace(nsp))
+    return true;
+  if (_namespaceCount >= ChBuffers::kMaxNamespaces)
+    return false;
+  Namespace &ns = _namespaces[_namespaceCount++];
+  ns.name = nsp;
+  ns.open = false;
+  if (_engineOpen)
+    _sendNamespaceOpen(ns);
+  return true;
+}
+
+void SioClient::on(const char *nsp, const char *event, TextHandler handler)
+{
+  if (!addNamespace(nsp))
+    return;
+  _findNamespace(nsp)->handlers[std::string(event)] = handler;
+}
+
+void SioClient::onOpen(const char *nsp, OpenHandler handler)
+{
+  if (!addNamespace(nsp))
+    return;
+  _findNamespace(nsp)->openHandler = handler;
+}
+
+bool SioClient::isOpen(const char *nsp)
+{
+  Namespace *ns = nsp ? _findNamespace(nsp) : &_namespaces[0];
+  return ns && ns->open && _ws.connected();
+}
+
+SioClient::Namespace *SioClient::_findNamespace(const char *name, size_t len)
+{
+  for (size_t i = 0; i < _namespaceCount; ++i)
+  {
+    const String &n = _namespaces[i].name;
+    if (n.length() == len && strncmp(n.c_str(), name, len) == 0)
+      return &_namespaces[i];
+  }
+  return nullptr;
+}
+
+SioClient::Namespace *SioClient::_findNamespace(const char *name)
+{
+  return _findNamespace(name, strlen(name));
+}
+
+// Resolves the optional "/nsp," prefix of a Socket.IO packet (after the type
+// digits) and advances packet past it. Packets without a prefix belong to "/".
+SioClient::Namespace *SioClient::_namespaceOf(const char *&packet, const char *end)
+{
+  if (packet < end && *packet == '/')
+  {
+    const char *p = packet;
+    while (p < end && *p != ',')
+      ++p;
+    Namespace *ns = _findNamespace(packet, p - packet);
+    packet = (p < end) ? p + 1 : p;
+    return ns;
+  }
+  return _findNamespace("/", 1);
+}
+
+// on("/hub", ...) or onOpen("/hub", ...) before begin(..., "/hub", ...)
+// registers a slot of its own. Fold it into slot 0 so the namespace is
+// opened once and all its handlers are found; handlers already on slot 0
+// win.
+void SioClient::_mergeDefaultNamespace()
+{
+  Namespace &def = _namespaces[0];
+  for (size_t i = 1; i < _namespaceCount; ++i)
+  {
+    if (_namespaces[i].name != def.name)
+      continue;
+    for (auto &h : _namespaces[i].handlers)
+      def.handlers.insert(h);
+    if (!def.openHandler)
+      def.openHandler = _namespaces[i].openHandler;
+    for (size_t j = i + 1; j < _namespaceCount; ++j)
+      _namespaces[j - 1] = _namespaces[j];
+    _namespaces[--_namespaceCount] = Namespace();
+    return;
+  }
+}
+
+void SioClient::_closeNamespaces()
+{
+  _engineOpen = false;
+  for (size_t i = 0; i < _namespaceCount; ++i)
+    _namespaces[i].open = false;
+  for (size_t i = 0; i < ChBuffers::kMaxPendingAcks; ++i)
+  {
+    _acks[i].id = 0;
+    _acks[i].handler = nullptr;
+  }
 }
 
 void SioClient::_handleText(const char *payload, size_t length)
 {
+  CH_PROFILE_SCOPE("sio.dispatch");
   // Serial.print("[SioClient] _handleText received: ");
   // for (size_t i = 0; i < length; ++i)
   //   Serial.print(payload[i]);
@@ -109,7 +635,7 @@ void SioClient::_handleText(const char *payload, size_t length)
   if (payload[0] == '0')
   {
     // Serial.println("EIO open frame received");
-    StaticJsonDocument<256> doc;
+    StaticJsonDocument<ChBuffers::kOpenDocSize> doc;
     auto err = deserializeJson(doc, payload + 1, length - 1);
     if (!err)
     {
@@ -118,7 +644,11 @@ void SioClient::_handleText(const char *payload, size_t length)
       // Serial.println(_pingIntervalMs);
     }
     _lastPingMs = millis();
-    _sendNamespaceOpen();
+    _engineOpen = true;
+    _ws.beginBatch();
+    for (size_t i = 0; i < _namespaceCount; ++i)
+      _sendNamespaceOpen(_namespaces[i]);
+    _ws.flush();
     return;
   }
   if (payload[0] == '2')
@@ -134,35 +664,86 @@ void SioClient::_handleText(const char *payload, size_t length)
     // Serial.println("[SioClient] Pong (3) received from server");
     return;
   }
-  if (payload[0] == '4' && length >= 2 && payload[1] == '0')
+  if (payload[0] != '4' || length < 2)
+    return;
+  const char *end = payload + length;
+  const char *start = payload + 2;
+  Namespace *ns = _namespaceOf(start, end);
+  if (!ns)
+    return;
+  if (payload[1] == '0')
   {
-    _open = true;
+    ns->open = true;
     // Serial.println("Namespace open ack (40) received");
-    if (_openHandler)
-      _openHandler();
+    if (_journal.enabled() && _journal.records(ns->name.c_str()) > 0)
+      _journal.compact();
+    if (ns->openHandler)
+    {
+      _journalBypass = true;
+      ns->openHandler();
+      _journalBypass = false;
+    }
+    _lastReplayMs = millis();
+    _journalLive = 0;
+    return;
+  }
+  if (payload[1] == '1' || payload[1] == '4')
+  {
+    // Namespace disconnect (41) or connect error (44).
+    ns->open = false;
     return;
   }
-  if (payload[0] == '4' && length >= 2 && payload[1] == '2')
+  if (payload[1] == '3')
   {
-    const char *start = payload + 2;
-    if (*start == '/')
+    uint32_t id = 0;
+    while (start < end && *start >= '0' && *start <= '9')
+      id = id * 10 + (*start++ - '0');
+    for (size_t i = 0; i < ChBuffers::kMaxPendingAcks; ++i)
     {
-      const char *comma = strchr(start, ',');
-      if (!comma)
-        return;
-      start = comma + 1;
+      PendingAck &ack = _acks[i];
+      if (ack.id != id || ack.ns != ns)
+        continue;
+      TextHandler handler = ack.handler;
+      ack.id = 0;
+      ack.handler = nullptr;
+      if (handler)
+        handler(start, end - start);
+      break;
     }
-    StaticJsonDocument<512> arr;
-    auto err = deserializeJson(arr, start);
+    return;
+  }
+  if (payload[1] == '2')
+  {
+    while (start < end && *start >= '0' && *start <= '9')
+      ++start; // ack id
+    StaticJsonDocument<ChBuffers::kEventDocSize> arr;
+    auto err = deserializeJson(arr, start, end - start);
     if (err)
       return;
     const char *evt = arr[0].as<const char *>();
+    if (!evt)
+      return;
     // Serial.print("Event frame received: ");
     // Serial.println(evt);
+    bool isControl = strcmp(evt, "control") == 0;
+    if (_controls.enabled() && isControl && ns == &_namespaces[0])
+    {
+      _controls.update(arr[1]["header"].as<const char *>(), _controlValue(arr[1]["values"]),
+                       arr[1]["from"].as<const char *>(), millis());
+    }
+    const char *from = arr[1]["from"].as<const char *>();
+    if (_peerLink.enabled() && ns == &_namespaces[0] && (isControl || strcmp(evt, "event") == 0) &&
+        _peerLink.isPeer(from))
+    {
+      // Already delivered over the LAN peer path?
+      float value = isControl ? _controlValue(arr[1]["values"]) : 0.0f;
+      if (_peerLink.isDuplicate(PeerLink::PathHub, from, arr[1]["header"].as<const char *>(), value, millis()))
+        return;
+    }
     String payloadStr;
     if (!arr[1].isNull())
     {
-      StaticJsonDocument<512> tmp;
+      StaticJsonDocument<ChBuffers::kPayloadDocSize> tmp;
       tmp.set(arr[1]);
       serializeJson(tmp, payloadStr);
     }
@@ -170,20 +751,18 @@ void SioClient::_handleText(const char *payload, size_t length)
     {
       payloadStr = "{}";
     }
-    auto it = _handlers.find(std::string(evt));
-    if (it != _handlers.end())
-    {
-      it->second(payloadStr.c_str(), payloadStr.length());
-    }
+    auto it = ns->handlers.find(std::string(evt));
+    if (it != ns->handlers.end())
+      _deliver(it->second, payloadStr.c_str(), payloadStr.length(), arr[1]["at"]);
     return;
   }
 }
 
-void SioClient::_sendNamespaceOpen()
+void SioClient::_sendNamespaceOpen(Namespace &ns)
 {
   String frame = "40";
-  if (_nsp.length() > 1)
-    frame += _nsp;
+  if (ns.name.length() > 1)
+    frame += ns.name;
   _ws.sendText(frame.c_str(), frame.length());
 }
 
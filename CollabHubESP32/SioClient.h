@@ -5,6 +5,49 @@
 #include <map>
 #include <string>
 #include "WsClient.h"
+#include "EndpointRace.h"
+#include "OfflineJournal.h"
+#include "ControlCache.h"
+#include "ClockSync.h"
+#include "PeerLink.h"
+
+// Per-loop() inbound drain limits; override in config.h.
+#ifndef SIO_POLL_MAX_FRAMES
+#define SIO_POLL_MAX_FRAMES 8
+#endif
+#ifndef SIO_POLL_BUDGET_US
+#define SIO_POLL_BUDGET_US 2000
+#endif
+
+// Multi-endpoint failover (only used when more than one endpoint is added).
+#ifndef SIO_RACE_TIMEOUT_MS
+#define SIO_RACE_TIMEOUT_MS 1500
+#endif
+#ifndef SIO_REPROBE_INTERVAL_MS
+#define SIO_REPROBE_INTERVAL_MS 60000
+#endif
+#ifndef SIO_SWITCH_MARGIN_MS
+#define SIO_SWITCH_MARGIN_MS 20
+#endif
+#ifndef SIO_PROBE_FAILURES
+#define SIO_PROBE_FAILURES 2 // failed probes of the active hub before leaving it
+#endif
+
+// begin() and endpoint switches only start the connect and the WebSocket
+// upgrade, and loop() finishes them, instead of waiting. For transports that
+// connect in the background (the host build); the ESP32's WiFiClient
+// connects blocking either way.
+#ifndef SIO_ASYNC_CONNECT
+#define SIO_ASYNC_CONNECT false
+#endif
+
+// Offline journal replay pacing (only used after enableJournal()).
+#ifndef SIO_JOURNAL_REPLAY_BATCH
+#define SIO_JOURNAL_REPLAY_BATCH 4
+#endif
+#ifndef SIO_JOURNAL_REPLAY_INTERVAL_MS
+#define SIO_JOURNAL_REPLAY_INTERVAL_MS 50
+#endif
 
 class SioClient
 {
@@ -14,23 +57,116 @@ public:
 
   SioClient();
   void begin(const char *host, uint16_t port, const char *nsp, bool useSSL, const char *username = nullptr);
-  void loop();
+  size_t loop();
+  void setPollBudget(size_t maxFrames, uint32_t budgetUs);
+  size_t pendingBytes();
   void emit(const char *event, const char *payloadJson);
+  void emit(const char *nsp, const char *event, const char *payloadJson);
+  bool emitWithAck(const char *nsp, const char *event, const char *payloadJson, TextHandler onAck);
+  void beginBatch();
+  bool flush();
+  void setNoDelay(bool noDelay);
   void on(const char *event, TextHandler handler);
   void onOpen(OpenHandler handler);
+  bool addNamespace(const char *nsp);
+  void on(const char *nsp, const char *event, TextHandler handler);
+  void onOpen(const char *nsp, OpenHandler handler);
+  bool isOpen(const char *nsp = nullptr);
   bool connected();
+  bool addEndpoint(const char *host, uint16_t port, bool useTls);
+  int activeEndpoint() const { return _activeEndpoint; }
+  const HubEndpoint &endpoint(size_t i) const { return _endpoints[i]; }
+  size_t endpointCount() const { return _endpointCount; }
+  bool enableJournal(const char *path);
+  OfflineJournal &journal() { return _journal; }
+  bool enableControlCache();
+  const ControlCache &controls() const { return _controls; }
+  void enableClockSync(const char *event);
+  ClockSync &clock() { return _clock; }
+  bool enablePeers(const char *room);
+  const PeerLink &peers() const { return _peerLink; }
 
 private:
+  friend struct ClientSlotSizes;
+  // One Socket.IO namespace multiplexed over the shared Engine.IO connection.
+  // Slot 0 is the namespace passed to begin().
+  struct Namespace
+  {
+    String name;
+    bool open = false;
+    OpenHandler openHandler = nullptr;
+    std::map<std::string, TextHandler> handlers;
+  };
+
   void _handleText(const char *payload, size_t length);
-  void _sendNamespaceOpen();
+  void _sendNamespaceOpen(Namespace &ns);
   void _sendPing();
+  Namespace *_findNamespace(const char *name, size_t len);
+  Namespace *_findNamespace(const char *name);
+  Namespace *_namespaceOf(const char *&packet, const char *end);
+  void _mergeDefaultNamespace();
+  void _closeNamespaces();
+  bool _connectBest();
+  bool _connectNext();
+  bool _connectTo(size_t index);
+  void _reprobe(uint32_t now);
+  bool _sendEvent(const char *nsp, const char *event, const char *payloadJson, uint32_t ackId = 0);
+  void _syncClock(uint32_t now);
+  void _sendToPeers(const char *event, const char *payloadJson);
+  void _dispatchPeerMessage(const char *event, const char *json, size_t len);
+  void _deliver(const TextHandler &handler, const char *json, size_t len, JsonVariant at);
+  void _replayJournal(uint32_t now);
 
   WsClient _ws;
-  String _nsp;
   String _username;
-  OpenHandler _openHandler = nullptr;
-  std::map<std::string, TextHandler> _handlers;
-  bool _open = false;
+  String _path;
+  HubEndpoint _endpoints[EndpointRace::kMaxEndpoints];
+  size_t _endpointCount = 0;
+  int _activeEndpoint = -1;
+  EndpointRace _race;
+  uint8_t _connectOrder[EndpointRace::kMaxEndpoints];
+  size_t _connectCount = 0;
+  size_t _connectIndex = 0; // next in _connectOrder to try
+  bool _connecting = false; // SIO_ASYNC_CONNECT upgrade in progress
+  uint32_t _lastProbeMs = 0;
+  uint8_t _activeProbeFailures = 0;
+  OfflineJournal _journal;
+  ControlCache _controls;
+
+  struct PendingAck
+  {
+    uint32_t id = 0; // 0 = free
+    Namespace *ns = nullptr;
+    TextHandler handler = nullptr;
+  };
+  PendingAck _acks[ChBuffers::kMaxPendingAcks];
+  uint32_t _nextAckId = 1;
+  ClockSync _clock;
+  String _clockEvent;
+  PeerLink _peerLink;
+  bool _journalBypass = false;
+  uint32_t _lastReplayMs = 0;
+  size_t _journalLive = 0; // emits journaled while open since the last replay
+  Namespace _namespaces[ChBuffers::kMaxNamespaces];
+  size_t _namespaceCount = 1;
+  bool _engineOpen = false;
   uint32_t _pingIntervalMs = 0;
   uint32_t _lastPingMs = 0;
+  size_t _pollMaxFrames = SIO_POLL_MAX_FRAMES;
+  uint32_t _pollBudgetUs = SIO_POLL_BUDGET_US;
 };
+
+// Sizes of the slot structs the client objects embed, for the budget checks
+// (see BufferBudget in BufferConfig.h).
+struct ClientSlotSizes
+{
+  static constexpr size_t kNamespace = sizeof(SioClient::Namespace);
+  static constexpr size_t kScheduled = sizeof(ClockSync::Scheduled);
+  static constexpr size_t kAck = sizeof(SioClient::PendingAck);
+  static constexpr size_t kPeer = sizeof(PeerLink::Peer);
+  static constexpr size_t kDedup = sizeof(PeerLink::Seen);
+  static constexpr size_t kControl = sizeof(ControlCache::Entry);
+};
+
+static_assert(BufferBudget<ChBuffers, ClientSlotSizes>::fitsStack, "CH buffer config exceeds CH_STACK_BUDGET");
+static_assert(BufferBudget<ChBuffers, ClientSlotSizes>::fitsRam, "CH buffer config exceeds CH_RAM_BUDGET");
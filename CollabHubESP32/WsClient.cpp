@@ -2,24 +2,16 @@
 #include "WsClient.h"
 #include <Arduino.h>
 #include <WiFiClientSecure.h>
+#include "Profiler.h"
+#include <utility>
 
-#if USE_TLS
-#define WS_CLIENT _clientSecure
-#else
-#define WS_CLIENT _clientPlain
-#endif
+// Points at _clientSecure or _clientPlain depending on the endpoint's scheme.
+#define WS_CLIENT (*_client)
 
-#if USE_TLS
 bool WsClient::connected()
 {
-  return _clientSecure.connected();
+  return WS_CLIENT.connected();
 }
-#else
-bool WsClient::connected()
-{
-  return _clientPlain.connected();
-}
-#endif
 
 static String _base64Encode(const uint8_t *data, size_t len)
 {
@@ -63,19 +55,36 @@ String WsClient::_genKey()
   return _base64Encode(key, 16);
 }
 
-bool WsClient::connect(const char *host, uint16_t port, const char *path)
+// Blocking: returns once the WebSocket upgrade has succeeded or failed.
+bool WsClient::connect(const char *host, uint16_t port, const char *path, bool useTls)
+{
+  if (!startConnect(host, port, path, useTls))
+    return false;
+  while (_upgrading && !_readHttpResponse())
+    delay(10);
+  return _handshook;
+}
+
+// Opens the TCP connection and sends the upgrade request. The response is
+// read by poll() as it arrives; until then upgrading() is true and nothing
+// can be sent. A failed upgrade disconnects.
+bool WsClient::startConnect(const char *host, uint16_t port, const char *path, bool useTls)
 {
   _host = host;
   _port = port;
   _path = path;
-#if USE_TLS
-  _clientSecure.setInsecure(); // For testing only; remove for production and use CA cert
-  if (!_clientSecure.connect(host, port))
-    return false;
-#else
-  if (!_clientPlain.connect(host, port))
+  disconnect();
+  if (useTls)
+  {
+    _clientSecure.setInsecure(); // For testing only; remove for production and use CA cert
+    _client = &_clientSecure;
+  }
+  else
+  {
+    _client = &_clientPlain;
+  }
+  if (!WS_CLIENT.connect(host, port))
     return false;
-#endif
   String key = _genKey();
   String req;
   req += "GET ";
@@ -99,51 +108,41 @@ bool WsClient::connect(const char *host, uint16_t port, const char *path)
   // Serial.println("[WsClient] --- HTTP handshake request ---");
   // Serial.print(req);
   // Serial.println("[WsClient] --- END HTTP handshake request ---");
-  for (size_t i = 0; i < req.length(); ++i)
-  {
-#if USE_TLS
-    _clientSecure.write(req[i]);
-#else
-    _clientPlain.write(req[i]);
-#endif
-  }
+  WS_CLIENT.setNoDelay(_noDelay);
+  _txLen = 0;
+  _batchDepth = 0;
+  _rawWrite((const uint8_t *)req.c_str(), req.length());
   // Serial.println("[WsClient] Sent handshake request, waiting for response...");
-  return _readHttpResponse();
+  _upgrading = true;
+  _upgradeStartMs = millis();
+  return true;
 }
 
+// Reads what has arrived of the HTTP upgrade response, without waiting.
+// True once a 101 response is complete; any other response, a closed
+// socket or 5 s without one ends the upgrade and disconnects.
 bool WsClient::_readHttpResponse()
 {
-  unsigned long start = millis();
-  String statusLine;
-  // Serial.println("[WsClient] Waiting for HTTP handshake response...");
-  while (millis() - start < 5000)
+  while (WS_CLIENT.available())
   {
-#if USE_TLS
-    while (_clientSecure.available())
-    {
-      char c = _clientSecure.read();
-      statusLine += c;
-      if (statusLine.endsWith("\r\n\r\n"))
-      {
-        _handshook = statusLine.startsWith("HTTP/1.1 101");
-        return _handshook;
-      }
-    }
-#else
-    while (_clientPlain.available())
+    char c = WS_CLIENT.read();
+    _httpResponse += c;
+    if (_httpResponse.endsWith("\r\n\r\n"))
     {
-      char c = _clientPlain.read();
-      statusLine += c;
-      if (statusLine.endsWith("\r\n\r\n"))
-      {
-        _handshook = statusLine.startsWith("HTTP/1.1 101");
-        return _handshook;
-      }
+      bool ok = _httpResponse.startsWith("HTTP/1.1 101");
+      _upgrading = false;
+      _httpResponse = "";
+      if (!ok)
+        disconnect();
+      _handshook = ok;
+      return ok;
     }
-#endif
-    delay(10);
   }
-  // Serial.println("WebSocket handshake timeout");
+  if (!WS_CLIENT.connected() || millis() - _upgradeStartMs >= 5000)
+  {
+    // Serial.println("WebSocket handshake timeout");
+    disconnect();
+  }
   return false;
 }
 
@@ -178,6 +177,7 @@ bool WsClient::_readFrame(String &out)
     {
       if (WS_CLIENT.available() < 2)
         return false;
+      CH_PROFILE_SCOPE("ws.header");
       _hdr1 = WS_CLIENT.read();
       _hdr2 = WS_CLIENT.read();
       _frameBuffer = "";
@@ -262,13 +262,27 @@ bool WsClient::_readFrame(String &out)
         _frameBuffer.reserve(_payloadLen);
       while (_payloadRead < _payloadLen)
       {
-        if (WS_CLIENT.available() == 0)
+        int avail = WS_CLIENT.available();
+        if (avail <= 0)
+          return false;
+        CH_PROFILE_SCOPE("ws.read");
+        // Read in chunks: per-byte read() costs a TLS record lookup each call.
+        uint8_t chunk[ChBuffers::kIoChunkSize];
+        size_t want = _payloadLen - _payloadRead;
+        if (want > sizeof(chunk))
+          want = sizeof(chunk);
+        if (want > (size_t)avail)
+          want = (size_t)avail;
+        int got = WS_CLIENT.read(chunk, want);
+        if (got <= 0)
           return false;
-        uint8_t b = WS_CLIENT.read();
         if (_masked)
-          b ^= _mask[_payloadRead % 4];
-        _frameBuffer += (char)b;
-        _payloadRead++;
+        {
+          for (int i = 0; i < got; ++i)
+            chunk[i] ^= _mask[(_payloadRead + i) % 4];
+        }
+        _frameBuffer.concat((const char *)chunk, got);
+        _payloadRead += got;
       }
       if (_opcode == 0x9)
       {
@@ -282,96 +296,157 @@ bool WsClient::_readFrame(String &out)
         _resetFrameState();
         return false;
       }
-      out = _frameBuffer;
+      out = std::move(_frameBuffer);
       _resetFrameState();
       return true;
     }
   }
 }
 
-void WsClient::poll(MessageHandler onMessage)
+// Drains complete frames until maxFrames have been dispatched, the socket has
+// no further complete header, or budgetUs (0 = unbounded) has elapsed. At
+// least one frame is attempted per call. Returns the number dispatched.
+size_t WsClient::poll(MessageHandler onMessage, size_t maxFrames, uint32_t budgetUs)
 {
+  CH_PROFILE_SCOPE("ws.poll");
+  if (_upgrading && !_readHttpResponse())
+    return 0;
+  size_t frames = 0;
+  uint32_t start = micros();
   String msg;
-  if (_readFrame(msg))
+  while (frames < maxFrames)
   {
-    onMessage(msg.c_str(), msg.length());
+    if (_readFrame(msg))
+    {
+      onMessage(msg.c_str(), msg.length());
+      frames++;
+    }
+    else if (_stage != StageHeader || !WS_CLIENT.connected() || WS_CLIENT.available() < 2)
+    {
+      // Partial frame or nothing buffered; resume on the next call.
+      break;
+    }
+    // else: a control/oversized frame was consumed, keep draining.
+    if (budgetUs > 0 && (uint32_t)(micros() - start) >= budgetUs)
+      break;
   }
+  return frames;
+}
+
+// Bytes still waiting in the socket receive buffer (not yet parsed).
+size_t WsClient::pendingBytes()
+{
+  if (!WS_CLIENT.connected())
+    return 0;
+  int n = WS_CLIENT.available();
+  return n > 0 ? (size_t)n : 0;
 }
 
+size_t WsClient::_rawWrite(const uint8_t *data, size_t len)
+{
+  _txWrites++;
+  return WS_CLIENT.write(data, len);
+}
+
+// Frames are encoded into _txBuf and written with a single write() so that
+// header, mask and payload share one TCP segment / TLS record. Outside a
+// batch the buffer is flushed immediately.
 bool WsClient::sendText(const char *data, size_t len)
 {
-#if USE_TLS
-  if (!_clientSecure.connected())
+  if (!_handshook || !WS_CLIENT.connected())
     return false;
-  uint8_t hdr1 = 0x81; // FIN + text
-  _clientSecure.write(&hdr1, 1);
-  uint8_t mask[4];
-  for (int i = 0; i < 4; i++)
-    mask[i] = (uint8_t)random(0, 256);
+  if (len >= 65536)
+    return false;
+  uint8_t hdr[8];
+  size_t hdrLen = 0;
+  hdr[hdrLen++] = 0x81; // FIN + text
   if (len < 126)
   {
-    uint8_t hdr2 = 0x80 | (uint8_t)len;
-    _clientSecure.write(&hdr2, 1);
-  }
-  else if (len < 65536)
-  {
-    uint8_t hdr2 = 0xFE;
-    _clientSecure.write(&hdr2, 1);
-    uint8_t ext[2] = {(uint8_t)(len >> 8), (uint8_t)(len & 0xFF)};
-    _clientSecure.write(ext, 2);
+    hdr[hdrLen++] = 0x80 | (uint8_t)len;
   }
   else
   {
-    return false;
-  }
-  _clientSecure.write(mask, 4);
-  for (size_t i = 0; i < len; i++)
-  {
-    uint8_t b = data[i] ^ mask[i % 4];
-    _clientSecure.write(&b, 1);
+    hdr[hdrLen++] = 0xFE;
+    hdr[hdrLen++] = (uint8_t)(len >> 8);
+    hdr[hdrLen++] = (uint8_t)(len & 0xFF);
   }
-  return true;
-#else
-  if (!_clientPlain.connected())
-    return false;
-  uint8_t hdr1 = 0x81; // FIN + text
-  _clientPlain.write(&hdr1, 1);
-  uint8_t mask[4];
+  uint8_t *mask = hdr + hdrLen;
   for (int i = 0; i < 4; i++)
     mask[i] = (uint8_t)random(0, 256);
-  if (len < 126)
-  {
-    uint8_t hdr2 = 0x80 | (uint8_t)len;
-    _clientPlain.write(&hdr2, 1);
-  }
-  else if (len < 65536)
-  {
-    uint8_t hdr2 = 0xFE;
-    _clientPlain.write(&hdr2, 1);
-    uint8_t ext[2] = {(uint8_t)(len >> 8), (uint8_t)(len & 0xFF)};
-    _clientPlain.write(ext, 2);
-  }
-  else
+  hdrLen += 4;
+
+  size_t frameLen = hdrLen + len;
+  if (_txLen + frameLen > kTxBufferSize)
+    _flushTx();
+  if (frameLen > kTxBufferSize)
   {
-    return false;
+    // Too large to buffer: stream it out in masked chunks.
+    _rawWrite(hdr, hdrLen);
+    uint8_t chunk[ChBuffers::kIoChunkSize];
+    size_t sent = 0;
+    while (sent < len)
+    {
+      size_t n = len - sent;
+      if (n > sizeof(chunk))
+        n = sizeof(chunk);
+      for (size_t i = 0; i < n; i++)
+        chunk[i] = (uint8_t)data[sent + i] ^ mask[(sent + i) % 4];
+      _rawWrite(chunk, n);
+      sent += n;
+    }
+    return true;
   }
-  _clientPlain.write(mask, 4);
+  memcpy(_txBuf + _txLen, hdr, hdrLen);
+  _txLen += hdrLen;
   for (size_t i = 0; i < len; i++)
-  {
-    uint8_t b = data[i] ^ mask[i % 4];
-    _clientPlain.write(&b, 1);
-  }
+    _txBuf[_txLen + i] = (uint8_t)data[i] ^ mask[i % 4];
+  _txLen += len;
+  if (_batchDepth == 0)
+    return _flushTx();
   return true;
-#endif
+}
+
+// Starts (or nests) a batch: frames queue in _txBuf until the matching flush().
+void WsClient::beginBatch()
+{
+  _batchDepth++;
+}
+
+// Ends one batch level; writes queued frames once the outermost batch closes.
+bool WsClient::flush()
+{
+  if (_batchDepth > 0)
+    _batchDepth--;
+  if (_batchDepth > 0)
+    return true;
+  return _flushTx();
+}
+
+bool WsClient::_flushTx()
+{
+  if (_txLen == 0)
+    return true;
+  size_t n = _txLen;
+  _txLen = 0;
+  if (!WS_CLIENT.connected())
+    return false;
+  return _rawWrite(_txBuf, n) == n;
+}
+
+void WsClient::setNoDelay(bool noDelay)
+{
+  _noDelay = noDelay;
+  if (WS_CLIENT.connected())
+    WS_CLIENT.setNoDelay(noDelay);
 }
 
 void WsClient::disconnect()
 {
-#if USE_TLS
-  _clientSecure.stop();
-#else
-  _clientPlain.stop();
-#endif
+  WS_CLIENT.stop();
   _handshook = false;
+  _upgrading = false;
+  _httpResponse = "";
+  _txLen = 0;
+  _batchDepth = 0;
   _resetFrameState();
 }
@@ -3,27 +3,40 @@
 #include <WiFiClientSecure.h>
 #include <WiFiClient.h>
 #include "config.h"
+#include "BufferConfig.h"
 #include <functional>
 
+// Disable Nagle so single emits leave immediately; batches are coalesced
+// explicitly with beginBatch()/flush().
+#ifndef WS_TCP_NODELAY
+#define WS_TCP_NODELAY true
+#endif
+
 class WsClient
 {
 public:
   using MessageHandler = std::function<void(const char *data, size_t len)>;
 
   WsClient() {}
-  bool connect(const char *host, uint16_t port, const char *path);
-  void poll(MessageHandler onMessage);
+  bool connect(const char *host, uint16_t port, const char *path, bool useTls = USE_TLS);
+  bool startConnect(const char *host, uint16_t port, const char *path, bool useTls = USE_TLS);
+  bool upgrading() const { return _upgrading; }
+  size_t poll(MessageHandler onMessage, size_t maxFrames = 1, uint32_t budgetUs = 0);
+  size_t pendingBytes();
   bool sendText(const char *data, size_t len);
+  void beginBatch();
+  bool flush();
+  void setNoDelay(bool noDelay);
+  uint32_t txWrites() const { return _txWrites; }
   bool connected();
   void disconnect();
 
 private:
-#if USE_TLS
   WiFiClientSecure _clientSecure;
-#else
   WiFiClient _clientPlain;
-#endif
-  static const size_t kMaxFrameSize = 2048;
+  WiFiClient *_client = &_clientPlain;
+  static const size_t kMaxFrameSize = ChBuffers::kMaxFrameSize;
+  static const size_t kTxBufferSize = ChBuffers::kTxBufferSize;
   enum FrameStage
   {
     StageHeader,
@@ -33,6 +46,9 @@ private:
   };
 
   bool _handshook = false;
+  bool _upgrading = false;
+  uint32_t _upgradeStartMs = 0;
+  String _httpResponse;
   String _host;
   uint16_t _port = 0;
   String _path;
@@ -41,6 +57,8 @@ private:
   bool _readHttpResponse();
   bool _readFrame(String &out);
   void _resetFrameState();
+  size_t _rawWrite(const uint8_t *data, size_t len);
+  bool _flushTx();
 
   FrameStage _stage = StageHeader;
   uint8_t _hdr1 = 0;
@@ -57,4 +75,10 @@ private:
   bool _dropFrame = false;
   bool _shouldClose = false;
   String _frameBuffer;
+
+  uint8_t _txBuf[kTxBufferSize];
+  size_t _txLen = 0;
+  uint8_t _batchDepth = 0;
+  bool _noDelay = WS_TCP_NODELAY;
+  uint32_t _txWrites = 0;
 };
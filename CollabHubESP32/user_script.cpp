@@ -8,7 +8,7 @@ extern SioClient sio;
 
 void emitControl(const char *header, float value, const char *mode, const char *target)
 {
-    StaticJsonDocument<256> doc;
+    StaticJsonDocument<ChBuffers::kEmitDocSize> doc;
     doc["header"] = header;
     doc["values"] = value;
     doc["mode"] = mode;
@@ -20,7 +20,7 @@ void emitControl(const char *header, float value, const char *mode, const char *
 
 void emitEvent(const char *header, const char *payload)
 {
-    StaticJsonDocument<256> doc;
+    StaticJsonDocument<ChBuffers::kEmitDocSize> doc;
     doc["header"] = header;
     doc["mode"] = "push";
     doc["target"] = "all";
@@ -33,9 +33,28 @@ void emitEvent(const char *header, const char *payload)
     sio.emit("event", s.c_str());
 }
 
+void emitEventAt(const char *header, uint32_t atSharedMs, const char *payload)
+{
+    StaticJsonDocument<ChBuffers::kEmitDocSize> doc;
+    doc["header"] = header;
+    doc["mode"] = "push";
+    doc["target"] = "all";
+    // Unsynced, the stamp would mean nothing to the receivers: send a plain
+    // event that fires on arrival.
+    if (sio.clock().synced())
+        doc["at"] = atSharedMs;
+    if (payload && strlen(payload) > 0)
+    {
+        doc["payload"] = payload;
+    }
+    String s;
+    serializeJson(doc, s);
+    sio.emit("event", s.c_str());
+}
+
 void emitChat(const char *text)
 {
-    StaticJsonDocument<128> doc;
+    StaticJsonDocument<ChBuffers::kChatDocSize> doc;
     doc["chat"] = text;
     doc["mode"] = "push";
     doc["target"] = "all";
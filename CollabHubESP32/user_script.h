@@ -64,6 +64,16 @@ void emitControl(const char *header, float value, const char *mode = "push", con
  */
 void emitEvent(const char *header, const char *payload = nullptr);
 
+/**
+ * @brief Emit an event message stamped with a shared (hub) time.
+ * Receivers with clock sync enabled fire it at that time instead of on arrival.
+ * Until this device's clock is synced the event is sent without a time.
+ * @param header Event header string
+ * @param atSharedMs Shared time in ms, e.g. sio.clock().sharedMs() + 250
+ * @param payload Optional payload string (default: nullptr)
+ */
+void emitEventAt(const char *header, uint32_t atSharedMs, const char *payload = nullptr);
+
 /**
  * @brief Emit a chat message to the server.
  * @param text Chat message text
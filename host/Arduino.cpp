@@ -0,0 +1,43 @@
+#include "Arduino.h"
+#include <chrono>
+#include <random>
+#include <stdio.h>
+#include <unistd.h>
+
+HardwareSerial Serial;
+
+namespace
+{
+  const auto kStart = std::chrono::steady_clock::now();
+  std::minstd_rand rng(std::random_device{}());
+}
+
+size_t HardwareSerial::write(uint8_t c)
+{
+  return fputc(c, stderr) == EOF ? 0 : 1;
+}
+
+size_t HardwareSerial::write(const uint8_t *buf, size_t n)
+{
+  return fwrite(buf, 1, n, stderr);
+}
+
+uint32_t millis()
+{
+  return (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - kStart).count();
+}
+
+uint32_t micros()
+{
+  return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - kStart).count();
+}
+
+void delay(uint32_t ms)
+{
+  usleep(ms * 1000);
+}
+
+long random(long lo, long hi)
+{
+  return hi > lo ? lo + (long)(rng() % (unsigned long)(hi - lo)) : lo;
+}
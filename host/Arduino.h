@@ -0,0 +1,134 @@
+#pragma once
+// Minimal Arduino core for building the sketch's protocol code on Linux
+// (see sim.cpp). Only what WsClient/SioClient and their helpers use.
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+class String
+{
+public:
+  String() {}
+  String(const char *s) { *this = s; }
+  String(const String &s) = default;
+  String(char c) : _s(1, c) {}
+  String(int v) : _s(std::to_string(v)) {}
+  String(unsigned int v) : _s(std::to_string(v)) {}
+  String(long v) : _s(std::to_string(v)) {}
+  String(unsigned long v) : _s(std::to_string(v)) {}
+
+  String &operator=(const String &s) = default;
+  String &operator=(const char *s)
+  {
+    if (s)
+      _s = s;
+    else
+      _s.clear();
+    return *this;
+  }
+  String &operator+=(const String &s) { return _s += s._s, *this; }
+  String &operator+=(const char *s) { return concat(s), *this; }
+  String &operator+=(char c) { return _s += c, *this; }
+
+  bool concat(const char *s) { return s ? (_s += s, true) : false; }
+  bool concat(const char *s, size_t n) { return s ? (_s.append(s, n), true) : false; }
+  bool concat(char c) { return _s += c, true; }
+  bool reserve(size_t n) { return _s.reserve(n), true; }
+
+  size_t length() const { return _s.size(); }
+  const char *c_str() const { return _s.c_str(); }
+  char operator[](size_t i) const { return i < _s.size() ? _s[i] : 0; }
+  bool isEmpty() const { return _s.empty(); }
+  bool startsWith(const String &p) const { return _s.compare(0, p._s.size(), p._s) == 0; }
+  bool endsWith(const String &p) const
+  {
+    return _s.size() >= p._s.size() && _s.compare(_s.size() - p._s.size(), p._s.size(), p._s) == 0;
+  }
+
+  bool operator==(const String &o) const { return _s == o._s; }
+  bool operator==(const char *o) const { return o && _s == o; }
+  bool operator!=(const String &o) const { return !(*this == o); }
+  bool operator!=(const char *o) const { return !(*this == o); }
+
+private:
+  std::string _s;
+};
+
+// ArduinoJson looks for this type next to String.
+class StringSumHelper : public String
+{
+public:
+  using String::String;
+  StringSumHelper(const String &s) : String(s) {}
+};
+
+inline StringSumHelper operator+(const String &a, const String &b)
+{
+  StringSumHelper r(a);
+  r += b;
+  return r;
+}
+inline StringSumHelper operator+(const String &a, const char *b)
+{
+  StringSumHelper r(a);
+  r += b;
+  return r;
+}
+
+class Print
+{
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t *buf, size_t n)
+  {
+    size_t i = 0;
+    while (i < n && write(buf[i]))
+      ++i;
+    return i;
+  }
+  size_t write(const char *buf, size_t n) { return write((const uint8_t *)buf, n); }
+  virtual int availableForWrite() { return 0; }
+  virtual void flush() {}
+
+  size_t print(const char *s) { return write(s, strlen(s)); }
+  size_t print(const String &s) { return write(s.c_str(), s.length()); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(int v) { return print(String(v)); }
+  size_t print(unsigned int v) { return print(String(v)); }
+  size_t print(long v) { return print(String(v)); }
+  size_t print(unsigned long v) { return print(String(v)); }
+  size_t println() { return print("\n"); }
+  template <class T>
+  size_t println(T v) { return print(v) + println(); }
+};
+
+class Stream : public Print
+{
+public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() { return -1; }
+};
+
+// stderr, so simulator reports on stdout stay clean.
+class HardwareSerial : public Stream
+{
+public:
+  void begin(unsigned long) {}
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t *buf, size_t n) override;
+  using Print::write;
+  int available() override { return 0; }
+  int read() override { return -1; }
+  int availableForWrite() override { return 4096; }
+};
+extern HardwareSerial Serial;
+
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+long random(long lo, long hi);
+inline void yield() {}
@@ -0,0 +1,241 @@
+#include "WiFiClient.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace
+{
+  WiFiClient::SocketHook socketHook;
+}
+
+void WiFiClient::setSocketHook(SocketHook hook)
+{
+  socketHook = hook;
+}
+
+int WiFiClient::connect(const char *host, uint16_t port)
+{
+  stop();
+  addrinfo hints = {};
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo *res = nullptr;
+  char service[8];
+  snprintf(service, sizeof(service), "%u", port);
+  if (getaddrinfo(host, service, &hints, &res) != 0 || !res)
+    return 0;
+  int fd = socket(res->ai_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  bool connecting = false;
+  bool ok = fd >= 0;
+  if (ok && ::connect(fd, res->ai_addr, res->ai_addrlen) != 0)
+  {
+    ok = errno == EINPROGRESS;
+    connecting = ok;
+  }
+  freeaddrinfo(res);
+  if (!ok)
+  {
+    if (fd >= 0)
+      close(fd);
+    return 0;
+  }
+  _fd = fd;
+  _eof = false;
+  _connecting = connecting;
+  _rxPos = _rxLen = 0;
+  _tx.clear();
+  if (socketHook)
+  {
+    socketHook(_fd, SocketOpen);
+    // Writable means the connect has completed (or failed).
+    if (_connecting)
+      socketHook(_fd, SocketWantWrite);
+  }
+  return 1;
+}
+
+void WiFiClient::stop()
+{
+  if (_fd < 0)
+    return;
+  if (socketHook)
+    socketHook(_fd, SocketClose);
+  close(_fd);
+  _fd = -1;
+  _connecting = false;
+  _rxPos = _rxLen = 0;
+  _tx.clear();
+}
+
+// Finishes a pending connect and sends as much of the queue as the socket
+// takes, without waiting. False once the connection has failed.
+bool WiFiClient::_sendQueued()
+{
+  if (_fd < 0 || _eof)
+    return false;
+  bool waiting = _connecting || !_tx.empty();
+  if (_connecting)
+  {
+    pollfd p = {_fd, POLLOUT, 0};
+    if (poll(&p, 1, 0) != 1)
+      return true;
+    int err = 0;
+    socklen_t len = sizeof(err);
+    if (getsockopt(_fd, SOL_SOCKET, SO_ERROR, &err, &len) != 0 || err != 0)
+    {
+      _eof = true;
+      return false;
+    }
+    _connecting = false;
+  }
+  size_t sent = 0;
+  while (sent < _tx.size())
+  {
+    ssize_t w = send(_fd, _tx.data() + sent, _tx.size() - sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (w > 0)
+    {
+      sent += (size_t)w;
+      continue;
+    }
+    if (w < 0 && errno == EINTR)
+      continue;
+    if (w < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+      _eof = true;
+    break;
+  }
+  _tx.erase(0, sent);
+  if (waiting && _tx.empty() && !_eof && socketHook)
+    socketHook(_fd, SocketWriteIdle);
+  return !_eof;
+}
+
+// Reads whatever the socket has into the buffer; false on EOF or error.
+bool WiFiClient::_fill()
+{
+  if (_fd < 0 || _eof)
+    return false;
+  if (_connecting || !_tx.empty())
+  {
+    if (!_sendQueued())
+      return false;
+    if (_connecting)
+      return true;
+  }
+  if (_rxPos > 0)
+  {
+    memmove(_rx, _rx + _rxPos, _rxLen - _rxPos);
+    _rxLen -= _rxPos;
+    _rxPos = 0;
+  }
+  if (_rxLen == sizeof(_rx))
+    return true;
+  ssize_t n = recv(_fd, _rx + _rxLen, sizeof(_rx) - _rxLen, MSG_DONTWAIT);
+  if (n > 0)
+    _rxLen += (uint16_t)n;
+  else if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+    _eof = true;
+  return !_eof;
+}
+
+// Like the ESP32 client: still connected while unread data is buffered.
+// Only peeks, so an event loop still sees the socket as readable.
+uint8_t WiFiClient::connected()
+{
+  if (_fd < 0)
+    return 0;
+  if (_rxLen > _rxPos)
+    return 1;
+  if (_connecting || !_tx.empty())
+    return _sendQueued();
+  if (!_eof)
+  {
+    char c;
+    ssize_t n = recv(_fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+      _eof = true;
+  }
+  return !_eof;
+}
+
+int WiFiClient::available()
+{
+  if (_rxLen - _rxPos < 16)
+    _fill();
+  return _rxLen - _rxPos;
+}
+
+int WiFiClient::read()
+{
+  if (_rxLen == _rxPos && !_fill())
+    return -1;
+  return _rxLen > _rxPos ? _rx[_rxPos++] : -1;
+}
+
+int WiFiClient::read(uint8_t *buf, size_t n)
+{
+  if (_rxLen == _rxPos)
+    _fill();
+  size_t have = _rxLen - _rxPos;
+  if (n > have)
+    n = have;
+  memcpy(buf, _rx + _rxPos, n);
+  _rxPos += (uint16_t)n;
+  return (int)n;
+}
+
+// Sends what the socket takes now and queues the rest behind any earlier
+// queued bytes; the queue drains as the socket becomes writable.
+size_t WiFiClient::write(const uint8_t *buf, size_t n)
+{
+  if (_fd < 0 || _eof)
+    return 0;
+  size_t sent = 0;
+  if (!_connecting && _tx.empty())
+  {
+    while (sent < n)
+    {
+      ssize_t w = send(_fd, buf + sent, n - sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+      if (w > 0)
+      {
+        sent += (size_t)w;
+        continue;
+      }
+      if (w < 0 && errno == EINTR)
+        continue;
+      if (w < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+      {
+        _eof = true;
+        return sent;
+      }
+      break;
+    }
+    if (sent == n)
+      return n;
+  }
+  size_t room = kTxQueueMax - _tx.size();
+  size_t queue = n - sent < room ? n - sent : room;
+  bool wasEmpty = _tx.empty();
+  _tx.append((const char *)buf + sent, queue);
+  if (wasEmpty && !_connecting && queue > 0 && socketHook)
+    socketHook(_fd, SocketWantWrite);
+  return sent + queue;
+}
+
+int WiFiClient::availableForWrite()
+{
+  if (_fd < 0 || _eof)
+    return 0;
+  return (int)(kTxQueueMax - _tx.size());
+}
+
+void WiFiClient::setNoDelay(bool noDelay)
+{
+  int on = noDelay ? 1 : 0;
+  if (_fd >= 0)
+    setsockopt(_fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+}
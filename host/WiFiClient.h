@@ -0,0 +1,63 @@
+#pragma once
+#include "Arduino.h"
+#include <functional>
+#include <string>
+
+// Host WiFiClient: a non-blocking TCP socket with the Arduino client API.
+// Reads are served from a small per-client buffer. Nothing here waits:
+// connect() only starts the TCP connect (the socket counts as connected
+// until it fails), and bytes the socket cannot take yet, including
+// everything written before the connect completes, are queued and sent as
+// it becomes writable. Host names are resolved with a blocking lookup;
+// the simulator uses addresses.
+//
+// Host-only: setSocketHook() reports every socket that is opened or closed,
+// and when it starts or stops waiting to become writable, so an event loop
+// (sim.cpp) can watch it and call back in (available(), connected(), ...)
+// to send the queue.
+class WiFiClient : public Stream
+{
+public:
+  enum SocketEvent
+  {
+    SocketOpen,
+    SocketClose,
+    SocketWantWrite, // queued bytes: watch for writable
+    SocketWriteIdle  // queue sent: readable only
+  };
+  using SocketHook = std::function<void(int fd, SocketEvent event)>;
+  static void setSocketHook(SocketHook hook);
+
+  WiFiClient() {}
+  ~WiFiClient() override { stop(); }
+  WiFiClient(const WiFiClient &) = delete;
+  WiFiClient &operator=(const WiFiClient &) = delete;
+
+  virtual int connect(const char *host, uint16_t port);
+  virtual void stop();
+  uint8_t connected();
+  int available() override;
+  int read() override;
+  int read(uint8_t *buf, size_t n);
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t *buf, size_t n) override;
+  using Print::write;
+  int availableForWrite() override;
+  void setNoDelay(bool noDelay);
+  int fd() const { return _fd; }
+  size_t queuedBytes() const { return _tx.size(); }
+
+private:
+  bool _fill();
+  bool _sendQueued();
+
+  static const size_t kRxBufferSize = 256;
+  static const size_t kTxQueueMax = 64 * 1024;
+  int _fd = -1;
+  bool _eof = false;
+  bool _connecting = false;
+  uint8_t _rx[kRxBufferSize];
+  uint16_t _rxPos = 0;
+  uint16_t _rxLen = 0;
+  std::string _tx;
+};
@@ -0,0 +1,11 @@
+#pragma once
+#include "WiFiClient.h"
+
+// No TLS on the host: the "secure" client carries the stream in the clear,
+// so the sketch's wss:// code path can be exercised against a plain hub
+// (e.g. hub_standin in the tests).
+class WiFiClientSecure : public WiFiClient
+{
+public:
+  void setInsecure() {}
+};
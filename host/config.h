@@ -0,0 +1,8 @@
+#pragma once
+// Settings for the host build. The sketch folder's own config.h, if present,
+// is found first and takes precedence; only USE_TLS matters here.
+#define HUB_HOST "127.0.0.1"
+#define HUB_PORT 3000
+#define HUB_NAMESPACE "/hub"
+#define IOT_ROOM "iot"
+#define USE_TLS false
@@ -0,0 +1,540 @@
+// Minimal stand-in for the Collab-Hub server, for running sim.cpp locally.
+//
+// Speaks just enough Engine.IO v4 / Socket.IO over WebSocket for the
+// sketch: namespace open/close, addUsername, joinRoom,
+// observeAllControl/observeAllEvents, and fan-out of control/event/chat to
+// the sender's room with "from" added. Events sent with an ack id get one
+// back; "serverTime" is acked with the wall clock in ms (for CLOCK_SYNC_EVENT).
+// Slow readers get messages dropped once their queue passes --max-queue.
+// Opening the namespace given with --reject fails with a connect error (44).
+//
+//   ./hub_standin [--port 3000] [--max-queue 1048576] [--reject /nsp]
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+namespace
+{
+  struct Conn
+  {
+    int fd = -1;
+    bool ws = false;
+    bool wantWrite = false;
+    std::string in;
+    std::string out;
+    std::string username;
+    std::string room;
+    std::vector<std::string> namespaces;
+    bool observeControl = false;
+    bool observeEvents = false;
+  };
+
+  std::vector<Conn *> conns; // by fd
+  int epfd = -1;
+  size_t maxQueue = 1 << 20;
+  std::string rejectNsp;
+  uint64_t msgsIn = 0, msgsOut = 0, bytesOut = 0, dropped = 0;
+  size_t openConns = 0;
+  uint32_t nextSid = 1;
+
+  uint64_t nowMs(clockid_t clock)
+  {
+    timespec ts;
+    clock_gettime(clock, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+  }
+
+  // ---- SHA-1 / base64 for Sec-WebSocket-Accept ----
+  void sha1(const uint8_t *data, size_t len, uint8_t out[20])
+  {
+    uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+    std::vector<uint8_t> msg(data, data + len);
+    msg.push_back(0x80);
+    while (msg.size() % 64 != 56)
+      msg.push_back(0);
+    uint64_t bits = (uint64_t)len * 8;
+    for (int i = 7; i >= 0; --i)
+      msg.push_back((uint8_t)(bits >> (i * 8)));
+    auto rol = [](uint32_t v, int n)
+    { return (v << n) | (v >> (32 - n)); };
+    for (size_t off = 0; off < msg.size(); off += 64)
+    {
+      uint32_t w[80];
+      for (int i = 0; i < 16; ++i)
+        w[i] = (uint32_t)msg[off + i * 4] << 24 | (uint32_t)msg[off + i * 4 + 1] << 16 |
+               (uint32_t)msg[off + i * 4 + 2] << 8 | msg[off + i * 4 + 3];
+      for (int i = 16; i < 80; ++i)
+        w[i] = rol(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+      uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+      for (int i = 0; i < 80; ++i)
+      {
+        uint32_t f, k;
+        if (i < 20)
+          f = (b & c) | (~b & d), k = 0x5A827999;
+        else if (i < 40)
+          f = b ^ c ^ d, k = 0x6ED9EBA1;
+        else if (i < 60)
+          f = (b & c) | (b & d) | (c & d), k = 0x8F1BBCDC;
+        else
+          f = b ^ c ^ d, k = 0xCA62C1D6;
+        uint32_t t = rol(a, 5) + f + e + k + w[i];
+        e = d, d = c, c = rol(b, 30), b = a, a = t;
+      }
+      h[0] += a, h[1] += b, h[2] += c, h[3] += d, h[4] += e;
+    }
+    for (int i = 0; i < 20; ++i)
+      out[i] = (uint8_t)(h[i / 4] >> (24 - (i % 4) * 8));
+  }
+
+  std::string base64(const uint8_t *p, size_t n)
+  {
+    static const char *tbl = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string out;
+    for (size_t i = 0; i < n; i += 3)
+    {
+      uint32_t v = (uint32_t)p[i] << 16 | (i + 1 < n ? (uint32_t)p[i + 1] << 8 : 0) | (i + 2 < n ? p[i + 2] : 0);
+      out += tbl[(v >> 18) & 63];
+      out += tbl[(v >> 12) & 63];
+      out += i + 1 < n ? tbl[(v >> 6) & 63] : '=';
+      out += i + 2 < n ? tbl[v & 63] : '=';
+    }
+    return out;
+  }
+
+  // ---- output ----
+  void watch(Conn *c)
+  {
+    epoll_event ev = {};
+    ev.events = EPOLLIN | (c->wantWrite ? EPOLLOUT : 0);
+    ev.data.fd = c->fd;
+    epoll_ctl(epfd, EPOLL_CTL_MOD, c->fd, &ev);
+  }
+
+  void flushOut(Conn *c)
+  {
+    while (!c->out.empty())
+    {
+      ssize_t n = send(c->fd, c->out.data(), c->out.size(), MSG_NOSIGNAL);
+      if (n <= 0)
+        break;
+      bytesOut += (uint64_t)n;
+      c->out.erase(0, (size_t)n);
+    }
+    bool want = !c->out.empty();
+    if (want != c->wantWrite)
+    {
+      c->wantWrite = want;
+      watch(c);
+    }
+  }
+
+  std::string frame(const std::string &text)
+  {
+    std::string f;
+    f += (char)0x81;
+    size_t n = text.size();
+    if (n < 126)
+    {
+      f += (char)n;
+    }
+    else if (n < 65536)
+    {
+      f += (char)126;
+      f += (char)(n >> 8);
+      f += (char)n;
+    }
+    else
+    {
+      f += (char)127;
+      for (int i = 7; i >= 0; --i)
+        f += (char)(n >> (i * 8));
+    }
+    return f + text;
+  }
+
+  void queue(Conn *c, const std::string &wsFrame)
+  {
+    if (c->out.size() > maxQueue)
+    {
+      dropped++;
+      return;
+    }
+    c->out += wsFrame;
+    msgsOut++;
+  }
+
+  void sendText(Conn *c, const std::string &text)
+  {
+    queue(c, frame(text));
+    flushOut(c);
+  }
+
+  // "42" + "/hub," (omitted for "/") + body
+  std::string packet(const char *type, const std::string &nsp, const std::string &body)
+  {
+    std::string p = type;
+    if (nsp != "/")
+      p += nsp + ",";
+    return p + body;
+  }
+
+  // Value of "key":"..." in a flat JSON object; enough for the sketch's emits.
+  std::string field(const std::string &json, const char *key)
+  {
+    std::string k = std::string("\"") + key + "\"";
+    size_t i = json.find(k);
+    if (i == std::string::npos)
+      return "";
+    i = json.find('"', json.find(':', i + k.size()));
+    if (i == std::string::npos)
+      return "";
+    size_t e = json.find('"', i + 1);
+    return e == std::string::npos ? "" : json.substr(i + 1, e - i - 1);
+  }
+
+  bool inNamespace(const Conn *c, const std::string &nsp)
+  {
+    for (const auto &n : c->namespaces)
+      if (n == nsp)
+        return true;
+    return false;
+  }
+
+  void broadcast(Conn *from, const std::string &nsp, const std::string &event, const std::string &payload)
+  {
+    std::string body = "{\"from\":\"" + from->username + "\"";
+    size_t brace = payload.find('{');
+    if (brace != std::string::npos)
+    {
+      std::string rest = payload.substr(brace + 1);
+      size_t first = rest.find_first_not_of(" \t\r\n");
+      if (first != std::string::npos && rest[first] != '}')
+        body += ",";
+      body += rest;
+    }
+    else
+    {
+      body += "}";
+    }
+    std::string f = frame(packet("42", nsp, "[\"" + event + "\"," + body + "]"));
+    bool isControl = event == "control";
+    bool isEvent = event == "event";
+    for (Conn *c : conns)
+    {
+      if (!c || !c->ws || c->room != from->room || !inNamespace(c, nsp))
+        continue;
+      if ((isControl && !c->observeControl) || (isEvent && !c->observeEvents))
+        continue;
+      queue(c, f);
+      flushOut(c);
+    }
+  }
+
+  void handleSocketIo(Conn *c, const std::string &msg)
+  {
+    if (msg == "2")
+    {
+      sendText(c, "3");
+      return;
+    }
+    if (msg.size() < 2 || msg[0] != '4')
+      return;
+    char type = msg[1];
+    size_t i = 2;
+    std::string nsp = "/";
+    if (i < msg.size() && msg[i] == '/')
+    {
+      size_t comma = msg.find(',', i);
+      nsp = msg.substr(i, comma == std::string::npos ? std::string::npos : comma - i);
+      i = comma == std::string::npos ? msg.size() : comma + 1;
+    }
+    if (type == '0')
+    {
+      if (nsp == rejectNsp)
+      {
+        sendText(c, packet("44", nsp, "{\"message\":\"Invalid namespace\"}"));
+        return;
+      }
+      if (!inNamespace(c, nsp))
+        c->namespaces.push_back(nsp);
+      sendText(c, packet("40", nsp, "{\"sid\":\"" + std::to_string(nextSid++) + "\"}"));
+      return;
+    }
+    if (type == '1')
+    {
+      for (size_t k = 0; k < c->namespaces.size(); ++k)
+        if (c->namespaces[k] == nsp)
+          c->namespaces.erase(c->namespaces.begin() + k);
+      return;
+    }
+    if (type != '2')
+      return;
+    msgsIn++;
+    size_t idStart = i;
+    while (i < msg.size() && msg[i] >= '0' && msg[i] <= '9')
+      ++i;
+    std::string ackId = msg.substr(idStart, i - idStart);
+    size_t evStart = msg.find('"', i);
+    size_t evEnd = evStart == std::string::npos ? evStart : msg.find('"', evStart + 1);
+    if (evEnd == std::string::npos)
+      return;
+    std::string event = msg.substr(evStart + 1, evEnd - evStart - 1);
+    size_t payStart = msg.find(',', evEnd);
+    size_t payEnd = msg.rfind(']');
+    std::string payload = (payStart != std::string::npos && payEnd > payStart) ? msg.substr(payStart + 1, payEnd - payStart - 1) : "{}";
+
+    if (event == "addUsername")
+      c->username = field(payload, "username");
+    else if (event == "joinRoom")
+      c->room = field(payload, "room");
+    else if (event == "observeAllControl")
+      c->observeControl = payload.find("true") != std::string::npos;
+    else if (event == "observeAllEvents")
+      c->observeEvents = payload.find("true") != std::string::npos;
+    else if (event == "control" || event == "event" || event == "chat")
+      broadcast(c, nsp, event, payload);
+
+    if (!ackId.empty())
+    {
+      std::string body = event == "serverTime" ? "[" + std::to_string(nowMs(CLOCK_REALTIME)) + "]" : "[]";
+      sendText(c, packet("43", nsp, ackId + body));
+    }
+  }
+
+  void closeConn(Conn *c)
+  {
+    if (c->ws)
+      openConns--;
+    epoll_ctl(epfd, EPOLL_CTL_DEL, c->fd, nullptr);
+    close(c->fd);
+    conns[c->fd] = nullptr;
+    delete c;
+  }
+
+  // Returns false when the connection must be closed.
+  bool handleHttp(Conn *c)
+  {
+    size_t end = c->in.find("\r\n\r\n");
+    if (end == std::string::npos)
+      return c->in.size() < 8192;
+    std::string req = c->in.substr(0, end);
+    c->in.erase(0, end + 4);
+    std::string key;
+    size_t k = req.find("Sec-WebSocket-Key:");
+    if (k != std::string::npos)
+    {
+      size_t s = req.find_first_not_of(' ', k + 18);
+      key = req.substr(s, req.find("\r\n", s) - s);
+    }
+    size_t u = req.find("username=");
+    if (u != std::string::npos)
+      c->username = req.substr(u + 9, req.find_first_of("& ", u + 9) - (u + 9));
+    if (key.empty())
+      return false;
+    std::string acceptSrc = key + "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+    uint8_t digest[20];
+    sha1((const uint8_t *)acceptSrc.data(), acceptSrc.size(), digest);
+    std::string resp = "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                       "Sec-WebSocket-Accept: " +
+                       base64(digest, 20) + "\r\n\r\n";
+    c->out += resp;
+    c->ws = true;
+    openConns++;
+    sendText(c, "0{\"sid\":\"" + std::to_string(nextSid++) +
+                    "\",\"upgrades\":[],\"pingInterval\":25000,\"pingTimeout\":20000,\"maxPayload\":1000000}");
+    return true;
+  }
+
+  bool handleFrames(Conn *c)
+  {
+    while (c->in.size() >= 2)
+    {
+      const uint8_t *p = (const uint8_t *)c->in.data();
+      uint8_t opcode = p[0] & 0x0F;
+      bool masked = p[1] & 0x80;
+      uint64_t len = p[1] & 0x7F;
+      size_t hdr = 2;
+      if (len == 126)
+      {
+        if (c->in.size() < 4)
+          return true;
+        len = (uint64_t)p[2] << 8 | p[3];
+        hdr = 4;
+      }
+      else if (len == 127)
+      {
+        if (c->in.size() < 10)
+          return true;
+        len = 0;
+        for (int i = 0; i < 8; ++i)
+          len = len << 8 | p[2 + i];
+        hdr = 10;
+      }
+      if (len > (1u << 20))
+        return false;
+      size_t maskOff = hdr;
+      if (masked)
+        hdr += 4;
+      if (c->in.size() < hdr + len)
+        return true;
+      std::string payload = c->in.substr(hdr, (size_t)len);
+      if (masked)
+        for (size_t i = 0; i < payload.size(); ++i)
+          payload[i] ^= p[maskOff + (i % 4)];
+      c->in.erase(0, hdr + (size_t)len);
+      if (opcode == 0x8)
+        return false;
+      if (opcode == 0x9)
+      {
+        queue(c, std::string("\x8A", 1) + (char)payload.size() + payload);
+        flushOut(c);
+      }
+      else if (opcode == 0x1)
+      {
+        handleSocketIo(c, payload);
+      }
+    }
+    return true;
+  }
+
+  void onReadable(Conn *c)
+  {
+    char buf[16384];
+    while (true)
+    {
+      ssize_t n = recv(c->fd, buf, sizeof(buf), 0);
+      if (n > 0)
+      {
+        c->in.append(buf, (size_t)n);
+        continue;
+      }
+      if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+      {
+        closeConn(c);
+        return;
+      }
+      break;
+    }
+    bool ok = c->ws ? handleFrames(c) : handleHttp(c);
+    if (ok && c->ws && !c->in.empty())
+      ok = handleFrames(c);
+    if (!ok)
+      closeConn(c);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  int port = 3000;
+  for (int i = 1; i + 1 < argc; i += 2)
+  {
+    if (!strcmp(argv[i], "--port"))
+      port = atoi(argv[i + 1]);
+    else if (!strcmp(argv[i], "--max-queue"))
+      maxQueue = (size_t)atol(argv[i + 1]);
+    else if (!strcmp(argv[i], "--reject"))
+      rejectNsp = argv[i + 1];
+  }
+  signal(SIGPIPE, SIG_IGN);
+  rlimit rl;
+  if (getrlimit(RLIMIT_NOFILE, &rl) == 0)
+  {
+    rl.rlim_cur = rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+  }
+
+  int lfd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+  int on = 1;
+  setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons((uint16_t)port);
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  if (bind(lfd, (sockaddr *)&addr, sizeof(addr)) != 0 || listen(lfd, 1024) != 0)
+  {
+    perror("listen");
+    return 1;
+  }
+  epfd = epoll_create1(0);
+  epoll_event ev = {};
+  ev.events = EPOLLIN;
+  ev.data.fd = lfd;
+  epoll_ctl(epfd, EPOLL_CTL_ADD, lfd, &ev);
+  fprintf(stderr, "hub stand-in listening on :%d\n", port);
+
+  uint64_t lastPing = nowMs(CLOCK_MONOTONIC);
+  uint64_t lastReport = lastPing;
+  uint64_t reportIn = 0, reportOut = 0, reportBytes = 0;
+  epoll_event events[256];
+  while (true)
+  {
+    int n = epoll_wait(epfd, events, 256, 100);
+    for (int i = 0; i < n; ++i)
+    {
+      int fd = events[i].data.fd;
+      if (fd == lfd)
+      {
+        int cfd;
+        while ((cfd = accept4(lfd, nullptr, nullptr, SOCK_NONBLOCK)) >= 0)
+        {
+          setsockopt(cfd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+          if ((size_t)cfd >= conns.size())
+            conns.resize(cfd + 1, nullptr);
+          Conn *c = new Conn;
+          c->fd = cfd;
+          conns[cfd] = c;
+          epoll_event cev = {};
+          cev.events = EPOLLIN;
+          cev.data.fd = cfd;
+          epoll_ctl(epfd, EPOLL_CTL_ADD, cfd, &cev);
+        }
+        continue;
+      }
+      Conn *c = (size_t)fd < conns.size() ? conns[fd] : nullptr;
+      if (!c)
+        continue;
+      if (events[i].events & EPOLLOUT)
+        flushOut(c);
+      if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+        onReadable(c);
+    }
+
+    uint64_t now = nowMs(CLOCK_MONOTONIC);
+    if (now - lastPing >= 25000)
+    {
+      lastPing = now;
+      std::string ping = frame("2");
+      for (Conn *c : conns)
+        if (c && c->ws)
+        {
+          queue(c, ping);
+          flushOut(c);
+        }
+    }
+    if (now - lastReport >= 1000)
+    {
+      double secs = (now - lastReport) / 1000.0;
+      fprintf(stderr, "clients %zu  in %.0f msg/s  out %.0f msg/s  %.2f MB/s  dropped %llu\n", openConns,
+              (msgsIn - reportIn) / secs, (msgsOut - reportOut) / secs, (bytesOut - reportBytes) / secs / 1e6,
+              (unsigned long long)dropped);
+      reportIn = msgsIn;
+      reportOut = msgsOut;
+      reportBytes = bytesOut;
+      lastReport = now;
+    }
+  }
+}
@@ -0,0 +1,472 @@
+// Many-device simulator: runs hundreds of SioClient instances, each doing
+// what CollabHubESP32.ino does (addUsername, joinRoom, observeAllControl,
+// observeAllEvents on open; reconnect when dropped), on one epoll loop, and
+// reports per-client latency and throughput.
+//
+// Emitting clients send "control" pushes with header "sim" and values
+// [client, seq, sentUs]; every client that receives one records
+// now - sentUs. Senders and receivers share this process's clock, so that
+// is the one-way hub latency plus this loop's own scheduling delay.
+//
+// Nothing blocks the loop: the host build connects with SIO_ASYNC_CONNECT, so
+// begin() only starts the TCP connect, and the WebSocket upgrade and any
+// bytes the socket could not take yet go out as epoll reports the socket
+// writable.
+//
+//   ./sim [--host 127.0.0.1] [--port 3000] [--nsp /hub] [--room iot]
+//         [--clients 100] [--emitters N] [--rate 10] [--payload 0]
+//         [--duration 30] [--ramp 100] [--csv per_client.csv]
+#include "Arduino.h"
+#include "WiFiClient.h"
+#include "SioClient.h"
+#include <ArduinoJson.h>
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <signal.h>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+  uint64_t nowUs()
+  {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+  // Log-linear latency histogram: exact below 8 us, then 4 buckets per
+  // power of two (about 12% resolution).
+  struct Histogram
+  {
+    static const int kBuckets = 124;
+    uint32_t counts[kBuckets] = {};
+    uint32_t total = 0;
+    uint32_t max = 0;
+
+    static int index(uint32_t v)
+    {
+      if (v < 8)
+        return (int)v;
+      int e = 31 - __builtin_clz(v);
+      return 8 + (e - 3) * 4 + (int)((v >> (e - 2)) & 3);
+    }
+    static uint32_t lowerBound(int i)
+    {
+      if (i < 8)
+        return (uint32_t)i;
+      int e = (i - 8) / 4 + 3;
+      return (uint32_t)(4 + (i - 8) % 4) << (e - 2);
+    }
+    void add(uint32_t v)
+    {
+      counts[index(v)]++;
+      total++;
+      if (v > max)
+        max = v;
+    }
+    void merge(const Histogram &o)
+    {
+      for (int i = 0; i < kBuckets; ++i)
+        counts[i] += o.counts[i];
+      total += o.total;
+      if (o.max > max)
+        max = o.max;
+    }
+    uint32_t percentile(double p) const
+    {
+      if (total == 0)
+        return 0;
+      uint64_t want = (uint64_t)(p * total + 0.5);
+      if (want == 0)
+        want = 1;
+      uint64_t seen = 0;
+      for (int i = 0; i < kBuckets; ++i)
+      {
+        seen += counts[i];
+        if (seen >= want)
+          return lowerBound(i);
+      }
+      return max;
+    }
+  };
+
+  struct Options
+  {
+    const char *host = "127.0.0.1";
+    uint16_t port = 3000;
+    const char *nsp = "/hub";
+    const char *room = "iot";
+    size_t clients = 100;
+    size_t emitters = SIZE_MAX;
+    double rate = 10;
+    size_t payload = 0;
+    double duration = 30;
+    double ramp = 100; // connects per second
+    const char *csv = nullptr;
+  };
+
+  struct Device
+  {
+    SioClient sio;
+    Histogram latency;
+    char name[16];
+    uint32_t id = 0;
+    bool started = false;
+    bool open = false;
+    bool ready = false; // bytes already pulled off the socket, not yet parsed
+    uint64_t beginUs = 0;
+    uint64_t openUs = 0;  // first open
+    uint64_t nextEmitUs = 0;
+    uint64_t nextRetryUs = 0;
+    uint64_t lastLoopUs = 0;
+    uint32_t connectUs = 0; // begin() to namespace open, first connect
+    uint32_t sent = 0;
+    uint32_t received = 0;
+    uint32_t reconnects = 0;
+  };
+
+  Options opt;
+  int epfd = -1;
+  Device *connecting = nullptr; // device whose socket the hook is about to see
+  std::vector<Device *> byFd;   // socket -> device, for later hook calls
+  volatile sig_atomic_t stopRequested = 0;
+  std::vector<Device *> ready;
+
+  size_t rssBytes()
+  {
+    FILE *f = fopen("/proc/self/statm", "r");
+    long pages = 0, resident = 0;
+    if (f)
+    {
+      if (fscanf(f, "%ld %ld", &pages, &resident) != 2)
+        resident = 0;
+      fclose(f);
+    }
+    return (size_t)resident * (size_t)sysconf(_SC_PAGESIZE);
+  }
+
+  // Same sequence as the sketch's onOpen handler.
+  void onOpen(Device *d)
+  {
+    d->sio.beginBatch();
+    StaticJsonDocument<ChBuffers::kEmitDocSize> doc;
+    doc["username"] = d->name;
+    String s1;
+    serializeJson(doc, s1);
+    d->sio.emit("addUsername", s1.c_str());
+
+    doc.clear();
+    doc["room"] = opt.room;
+    String s2;
+    serializeJson(doc, s2);
+    d->sio.emit("joinRoom", s2.c_str());
+
+    doc.clear();
+    doc["observe"] = true;
+    String s3;
+    serializeJson(doc, s3);
+    d->sio.emit("observeAllControl", s3.c_str());
+    d->sio.emit("observeAllEvents", s3.c_str());
+    d->sio.flush();
+
+    uint64_t now = nowUs();
+    if (d->openUs == 0)
+    {
+      d->openUs = now;
+      d->connectUs = (uint32_t)(now - d->beginUs);
+    }
+    d->open = true;
+  }
+
+  void onControl(Device *d, const char *json, size_t len)
+  {
+    uint64_t now = nowUs();
+    StaticJsonDocument<ChBuffers::kPayloadDocSize> doc;
+    if (deserializeJson(doc, json, len))
+      return;
+    const char *header = doc["header"] | "";
+    if (strcmp(header, "sim") != 0)
+      return;
+    uint64_t sentUs = (uint64_t)doc["values"][2].as<double>();
+    d->received++;
+    d->latency.add(now > sentUs ? (uint32_t)(now - sentUs) : 0);
+  }
+
+  // Runs one loop() pass. Bytes the client already read off the socket do
+  // not wake epoll again, so such clients are queued for another pass.
+  void service(Device *d)
+  {
+    d->sio.loop();
+    d->lastLoopUs = nowUs();
+    if (!d->ready && d->sio.pendingBytes() > 0)
+    {
+      d->ready = true;
+      ready.push_back(d);
+    }
+  }
+
+  void connect(Device *d)
+  {
+    connecting = d;
+    d->beginUs = nowUs();
+    d->sio.begin(opt.host, opt.port, opt.nsp, false, d->name);
+    connecting = nullptr;
+    d->lastLoopUs = nowUs();
+  }
+
+  void start(Device *d)
+  {
+    d->sio.onOpen([d]()
+                  { onOpen(d); });
+    d->sio.on("control", [d](const char *json, size_t len)
+              { onControl(d, json, len); });
+    d->started = true;
+    connect(d);
+  }
+
+  void emitControl(Device *d, uint64_t now, const char *pad)
+  {
+    char buf[160];
+    int n = snprintf(buf, sizeof(buf), "{\"header\":\"sim\",\"values\":[%u,%u,%llu],\"mode\":\"push\",\"target\":\"all\"",
+                     (unsigned)d->id, (unsigned)d->sent, (unsigned long long)now);
+    String s;
+    s.reserve((size_t)n + opt.payload + 16);
+    s.concat(buf, (size_t)n);
+    if (opt.payload > 0)
+    {
+      s += ",\"pad\":\"";
+      s.concat(pad, opt.payload);
+      s += "\"";
+    }
+    s += "}";
+    d->sio.emit("control", s.c_str());
+    d->sent++;
+  }
+
+  void parseArgs(int argc, char **argv)
+  {
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+      const char *k = argv[i];
+      const char *v = argv[i + 1];
+      if (!strcmp(k, "--host"))
+        opt.host = v;
+      else if (!strcmp(k, "--port"))
+        opt.port = (uint16_t)atoi(v);
+      else if (!strcmp(k, "--nsp"))
+        opt.nsp = v;
+      else if (!strcmp(k, "--room"))
+        opt.room = v;
+      else if (!strcmp(k, "--clients"))
+        opt.clients = (size_t)atol(v);
+      else if (!strcmp(k, "--emitters"))
+        opt.emitters = (size_t)atol(v);
+      else if (!strcmp(k, "--rate"))
+        opt.rate = atof(v);
+      else if (!strcmp(k, "--payload"))
+        opt.payload = (size_t)atol(v);
+      else if (!strcmp(k, "--duration"))
+        opt.duration = atof(v);
+      else if (!strcmp(k, "--ramp"))
+        opt.ramp = atof(v);
+      else if (!strcmp(k, "--csv"))
+        opt.csv = v;
+      else
+        fprintf(stderr, "unknown option %s\n", k);
+    }
+    if (opt.emitters > opt.clients)
+      opt.emitters = opt.clients;
+    if (opt.ramp <= 0)
+      opt.ramp = 1e9;
+  }
+}
+
+int main(int argc, char **argv)
+{
+  parseArgs(argc, argv);
+  signal(SIGPIPE, SIG_IGN);
+  signal(SIGINT, [](int)
+         { stopRequested = 1; });
+  rlimit rl;
+  if (getrlimit(RLIMIT_NOFILE, &rl) == 0)
+  {
+    rl.rlim_cur = rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+  }
+
+  epfd = epoll_create1(0);
+  WiFiClient::setSocketHook([](int fd, WiFiClient::SocketEvent event)
+                            {
+                              if (event == WiFiClient::SocketClose)
+                              {
+                                epoll_ctl(epfd, EPOLL_CTL_DEL, fd, nullptr);
+                                return;
+                              }
+                              if (event == WiFiClient::SocketOpen)
+                              {
+                                if ((size_t)fd >= byFd.size())
+                                  byFd.resize((size_t)fd + 1);
+                                byFd[fd] = connecting;
+                              }
+                              epoll_event ev = {};
+                              ev.events = event == WiFiClient::SocketWantWrite ? EPOLLIN | EPOLLOUT : EPOLLIN;
+                              ev.data.ptr = byFd[fd];
+                              epoll_ctl(epfd, event == WiFiClient::SocketOpen ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, fd, &ev); });
+
+  size_t rssBefore = rssBytes();
+  std::vector<Device *> devices;
+  devices.reserve(opt.clients);
+  for (size_t i = 0; i < opt.clients; ++i)
+  {
+    Device *d = new Device;
+    d->id = (uint32_t)i;
+    snprintf(d->name, sizeof(d->name), "SIM-%04u", (unsigned)i);
+    devices.push_back(d);
+  }
+  std::string pad(opt.payload, 'x');
+  fprintf(stderr, "%zu clients (%zu emitting %.1f msg/s), sizeof(SioClient) %zu, sizeof(Device) %zu\n",
+          opt.clients, opt.emitters, opt.rate, sizeof(SioClient), sizeof(Device));
+
+  const uint64_t period = opt.rate > 0 ? (uint64_t)(1e6 / opt.rate) : 0;
+  const uint64_t rampStep = (uint64_t)(1e6 / opt.ramp);
+  const uint64_t t0 = nowUs();
+  const uint64_t end = t0 + (uint64_t)(opt.duration * 1e6);
+  uint64_t nextStart = t0;
+  uint64_t lastReport = t0;
+  size_t started = 0;
+  uint32_t lastSent = 0, lastReceived = 0;
+  uint64_t waitUs = 0, lastWaitUs = 0; // time blocked in epoll_wait
+  epoll_event events[512];
+
+  while (!stopRequested)
+  {
+    uint64_t now = nowUs();
+    if (now >= end)
+      break;
+    while (started < devices.size() && now >= nextStart)
+    {
+      start(devices[started++]);
+      nextStart += rampStep;
+      now = nowUs();
+    }
+
+    uint64_t waitStart = nowUs();
+    int n = epoll_wait(epfd, events, 512, ready.empty() ? 1 : 0);
+    waitUs += nowUs() - waitStart;
+    std::vector<Device *> again;
+    again.swap(ready);
+    for (Device *d : again)
+      d->ready = false;
+    for (int i = 0; i < n; ++i)
+      service((Device *)events[i].data.ptr);
+    for (Device *d : again)
+      if (!d->ready)
+        service(d);
+
+    now = nowUs();
+    for (size_t i = 0; i < started; ++i)
+    {
+      Device *d = devices[i];
+      if (!d->sio.connected())
+      {
+        if (d->open)
+        {
+          d->open = false;
+          d->nextRetryUs = now + 1000000;
+        }
+        if (now >= d->nextRetryUs)
+        {
+          d->reconnects++;
+          connect(d);
+          d->nextRetryUs = nowUs() + 5000000;
+        }
+        continue;
+      }
+      // Housekeeping (ping timeout, journal, clock) for idle sockets.
+      if (now - d->lastLoopUs > 50000)
+        service(d);
+      // Emit only once the ramp is done, so the rates are for the full room.
+      if (d->open && period > 0 && d->id < opt.emitters && started == devices.size() && d->sio.isOpen())
+      {
+        if (d->nextEmitUs == 0)
+          d->nextEmitUs = now + (uint64_t)random(0, (long)period);
+        if (now >= d->nextEmitUs)
+        {
+          emitControl(d, now, pad.c_str());
+          d->nextEmitUs += period;
+          if (d->nextEmitUs + 1000000 < now)
+            d->nextEmitUs = now + period; // fell behind by >1 s: skip
+        }
+      }
+    }
+
+    if (now - lastReport >= 1000000)
+    {
+      size_t openCount = 0;
+      uint32_t sent = 0, received = 0;
+      for (Device *d : devices)
+      {
+        openCount += d->open;
+        sent += d->sent;
+        received += d->received;
+      }
+      double secs = (now - lastReport) / 1e6;
+      // Near 100% busy means this process, not the hub, limits the numbers.
+      fprintf(stderr, "t=%4.0fs open %zu/%zu  sent %.0f msg/s  received %.0f msg/s  sim busy %.0f%%\n",
+              (now - t0) / 1e6, openCount, devices.size(), (sent - lastSent) / secs, (received - lastReceived) / secs,
+              100.0 - (waitUs - lastWaitUs) / 1e4 / secs);
+      lastWaitUs = waitUs;
+      lastSent = sent;
+      lastReceived = received;
+      lastReport = now;
+    }
+  }
+
+  uint64_t tEnd = nowUs();
+  FILE *csv = opt.csv ? fopen(opt.csv, "w") : nullptr;
+  if (csv)
+    fprintf(csv, "client,connect_ms,reconnects,sent,received,sent_per_s,received_per_s,p50_us,p99_us,max_us\n");
+  Histogram all;
+  uint64_t totalSent = 0, totalReceived = 0, totalReconnects = 0;
+  Histogram connectMs;
+  size_t everOpen = 0;
+  for (Device *d : devices)
+  {
+    double secs = d->openUs ? (tEnd - d->openUs) / 1e6 : 0;
+    if (csv)
+      fprintf(csv, "%s,%.1f,%u,%u,%u,%.1f,%.1f,%u,%u,%u\n", d->name, d->connectUs / 1000.0, d->reconnects, d->sent,
+              d->received, secs > 0 ? d->sent / secs : 0, secs > 0 ? d->received / secs : 0,
+              d->latency.percentile(0.5), d->latency.percentile(0.99), d->latency.max);
+    all.merge(d->latency);
+    totalSent += d->sent;
+    totalReceived += d->received;
+    totalReconnects += d->reconnects;
+    if (d->openUs)
+    {
+      everOpen++;
+      connectMs.add(d->connectUs / 1000);
+    }
+  }
+  if (csv)
+    fclose(csv);
+
+  double secs = (tEnd - t0) / 1e6;
+  printf("clients           %zu (%zu connected, %llu reconnects)\n", devices.size(), everOpen,
+         (unsigned long long)totalReconnects);
+  printf("connect ms        p50 %u  p99 %u  max %u\n", connectMs.percentile(0.5), connectMs.percentile(0.99),
+         connectMs.max);
+  printf("sent              %llu (%.0f msg/s)\n", (unsigned long long)totalSent, totalSent / secs);
+  printf("received          %llu (%.0f msg/s)\n", (unsigned long long)totalReceived, totalReceived / secs);
+  printf("latency us        p50 %u  p90 %u  p99 %u  p99.9 %u  max %u\n", all.percentile(0.5), all.percentile(0.9),
+         all.percentile(0.99), all.percentile(0.999), all.max);
+  printf("sim busy          %.0f%%\n", 100.0 - waitUs / 1e4 / secs);
+  printf("memory            %.1f KB per client (RSS), sizeof(Device) %zu\n",
+         devices.empty() ? 0.0 : (double)(rssBytes() - rssBefore) / devices.size() / 1024, sizeof(Device));
+  for (Device *d : devices)
+    delete d;
+  return 0;
+}
@@ -0,0 +1,133 @@
+// ClockSync with jittered, asymmetric round trips: two simulated devices
+// estimate the hub clock from their own samples, then fire the same
+// scheduled events. Checks the offset error against the true offset and
+// how far apart (in hub time) and how late the events fire, and that an
+// event stamped too far ahead does not take a queue slot.
+#include "Arduino.h"
+#include "ClockSync.h"
+#include "test_util.h"
+#include <random>
+
+namespace
+{
+  std::mt19937 rng(12345);
+
+  // One-way delay: 3 ms of propagation plus exponential queueing delay
+  // (mean 2 ms), drawn independently for each direction.
+  uint64_t oneWayUs()
+  {
+    std::exponential_distribution<double> queueing(1.0 / 2000.0);
+    return 3000 + (uint64_t)queueing(rng);
+  }
+
+  struct Device
+  {
+    ClockSync clock;
+    int64_t trueOffsetUs; // hub time - this device's local time
+    int64_t firedHubUs = 0;
+    uint32_t fireGapUs = 0; // gap before the tick() that fired the event
+
+    // A request/ack exchange, stamped the way SioClient stamps it.
+    void sample()
+    {
+      uint64_t t0 = clock.localUs();
+      uint64_t up = oneWayUs();
+      uint64_t down = oneWayUs();
+      int64_t serverMs = ((int64_t)(t0 + up) + trueOffsetUs) / 1000;
+      clock.addSample(t0, serverMs, t0 + up + down);
+    }
+    int64_t hubNowUs() { return (int64_t)clock.localUs() + trueOffsetUs; }
+  };
+
+  // A loop() of 0-300 us; spins so the host's sleep granularity does not
+  // add to the fire error.
+  void jitteredLoop()
+  {
+    std::uniform_int_distribution<uint32_t> loopUs(0, 300);
+    uint32_t start = micros();
+    uint32_t us = loopUs(rng);
+    while (micros() - start < us)
+      ;
+  }
+}
+
+int main()
+{
+  const int64_t hubEpochUs = 1700000000000000LL;
+  Device a, b;
+  a.trueOffsetUs = b.trueOffsetUs = hubEpochUs;
+
+  int64_t worstErrorUs = 0;
+  for (int round = 0; round < 50; ++round)
+  {
+    for (Device *d : {&a, &b})
+    {
+      d->sample();
+      if (round >= (int)ClockSync::kSamples)
+      {
+        int64_t err = d->clock.offsetUs() - d->trueOffsetUs;
+        worstErrorUs = std::max(worstErrorUs, err < 0 ? -err : err);
+      }
+    }
+  }
+  // Min-RTT selection over 8 samples keeps the asymmetry error below the
+  // 2 ms mean queueing delay, plus up to 0.5 ms for the 1 ms server stamps.
+  CHECK(worstErrorUs < 2000);
+
+  // An event fires on the first tick() after its time, so its fire error is
+  // bounded by the gap since the previous tick(), including any time this
+  // process was descheduled.
+  int64_t worstSpreadUs = 0;
+  uint32_t gapUs = 0;
+  uint32_t worstFireGapUs = 0;
+  for (int round = 0; round < 20; ++round)
+  {
+    uint32_t at = a.clock.sharedMs() + 20;
+    a.firedHubUs = b.firedHubUs = 0;
+    a.clock.schedule(at, [&](const char *, size_t)
+                     { a.firedHubUs = a.hubNowUs(); a.fireGapUs = gapUs; },
+                     "{}", 2);
+    b.clock.schedule(at, [&](const char *, size_t)
+                     { b.firedHubUs = b.hubNowUs(); b.fireGapUs = gapUs; },
+                     "{}", 2);
+    uint32_t start = millis();
+    uint32_t lastTick = micros();
+    while ((!a.firedHubUs || !b.firedHubUs) && millis() - start < 200)
+    {
+      uint32_t now = micros();
+      gapUs = now - lastTick;
+      lastTick = now;
+      a.clock.tick();
+      b.clock.tick();
+      jitteredLoop();
+    }
+    CHECK(a.firedHubUs && b.firedHubUs);
+    CHECK(a.clock.lastFireErrorUs() >= 0 && a.clock.lastFireErrorUs() <= (int32_t)a.fireGapUs + 50);
+    CHECK(b.clock.lastFireErrorUs() >= 0 && b.clock.lastFireErrorUs() <= (int32_t)b.fireGapUs + 50);
+    int64_t spread = a.firedHubUs - b.firedHubUs;
+    // Both offset errors plus both fire errors.
+    CHECK(spread <= 2 * worstErrorUs + a.fireGapUs + b.fireGapUs + 100 &&
+          -spread <= 2 * worstErrorUs + a.fireGapUs + b.fireGapUs + 100);
+    worstSpreadUs = std::max(worstSpreadUs, spread < 0 ? -spread : spread);
+    worstFireGapUs = std::max(worstFireGapUs, std::max(a.fireGapUs, b.fireGapUs));
+  }
+  CHECK(a.clock.maxFireErrorUs() <= (int32_t)worstFireGapUs + 50);
+  CHECK(b.clock.maxFireErrorUs() <= (int32_t)worstFireGapUs + 50);
+  // A stamp a minute ahead fires on arrival; one within the limit waits.
+  bool farFired = false, nearFired = false;
+  a.clock.schedule(a.clock.sharedMs() + 60000, [&](const char *, size_t)
+                   { farFired = true; },
+                   "{}", 2);
+  CHECK(farFired);
+  CHECK(a.clock.farEvents() == 1);
+  a.clock.schedule(a.clock.sharedMs() + CLOCK_SYNC_MAX_AHEAD_MS - 1000, [&](const char *, size_t)
+                   { nearFired = true; },
+                   "{}", 2);
+  a.clock.tick();
+  CHECK(!nearFired);
+  CHECK(a.clock.farEvents() == 1);
+
+  fprintf(stderr, "  offset error <= %lld us, spread <= %lld us, max fire error %d / %d us\n",
+          (long long)worstErrorUs, (long long)worstSpreadUs, a.clock.maxFireErrorUs(), b.clock.maxFireErrorUs());
+  return testResult("test_clock_sync");
+}
@@ -0,0 +1,117 @@
+// Endpoint racing against several hub_standin instances (plus one port
+// nothing listens on): probe results, the timing bounds of a probe that is
+// polled late, that start() only uses resolved addresses, and failover to
+// the next hub when the active one goes away.
+#include "Arduino.h"
+#include "SioClient.h"
+#include "test_util.h"
+
+namespace
+{
+  const uint16_t kDeadPort = 39200;
+  const uint16_t kPortA = 39201;
+  const uint16_t kPortB = 39202;
+
+  void addEndpoints(HubEndpoint *eps)
+  {
+    const uint16_t ports[] = {kDeadPort, kPortA, kPortB};
+    for (size_t i = 0; i < 3; ++i)
+    {
+      eps[i].host = "127.0.0.1";
+      eps[i].port = ports[i];
+    }
+  }
+
+  void testProbe()
+  {
+    HubEndpoint eps[3];
+    addEndpoints(eps);
+    EndpointRace race;
+    race.run(eps, 3, 500);
+    CHECK(!eps[0].reachable);
+    CHECK(eps[1].reachable && eps[2].reachable);
+    for (size_t i = 1; i < 3; ++i)
+    {
+      CHECK(eps[i].rttMinMs <= eps[i].rttMs);
+      CHECK(eps[i].rttMs - eps[i].rttMinMs <= 2); // polled every ms
+      CHECK(eps[i].rttMs < 50);
+    }
+  }
+
+  // Polled once after 30 ms, like a reprobe behind a slow loop(): the
+  // bounds must cover the whole interval instead of claiming 30 ms.
+  void testLatePoll()
+  {
+    HubEndpoint eps[3];
+    addEndpoints(eps);
+    for (size_t i = 0; i < 3; ++i)
+      EndpointRace::resolve(eps[i]);
+    EndpointRace race;
+    race.start(eps, 3, 500);
+    delay(30);
+    CHECK(race.poll());
+    for (size_t i = 1; i < 3; ++i)
+    {
+      CHECK(eps[i].reachable);
+      CHECK(eps[i].rttMinMs == 0);
+      CHECK(eps[i].rttMs >= 30);
+    }
+  }
+
+  // start() is what loop() calls: it must not look up host names, so
+  // endpoints that were never resolved are reported unreachable at once.
+  void testUnresolved()
+  {
+    HubEndpoint eps[3];
+    addEndpoints(eps);
+    EndpointRace race;
+    race.start(eps, 3, 500);
+    CHECK(race.poll());
+    for (size_t i = 0; i < 3; ++i)
+      CHECK(!eps[i].reachable);
+    for (size_t i = 0; i < 3; ++i)
+      CHECK(EndpointRace::resolve(eps[i]));
+    race.start(eps, 3, 500);
+    while (!race.poll())
+      delay(1);
+    CHECK(eps[1].reachable && eps[2].reachable);
+  }
+
+  void testFailover(pid_t hubs[2])
+  {
+    SioClient sio;
+    sio.addEndpoint("127.0.0.1", kDeadPort, false);
+    sio.addEndpoint("127.0.0.1", kPortA, false);
+    sio.addEndpoint("127.0.0.1", kPortB, false);
+    sio.begin(nullptr, 0, "/hub", false, "race");
+    auto open = [&]()
+    { return sio.isOpen(); };
+    auto step = [&]()
+    { sio.loop(); };
+    CHECK(runUntil(open, step, 2000));
+    int first = sio.activeEndpoint();
+    CHECK(first == 1 || first == 2);
+    CHECK(!sio.endpoint(0).reachable);
+
+    stopHub(hubs[first - 1]);
+    hubs[first - 1] = -1;
+    CHECK(runUntil([&]()
+                   { return !sio.connected(); },
+                   step, 2000));
+    sio.begin(nullptr, 0, "/hub", false);
+    CHECK(runUntil(open, step, 2000));
+    CHECK(sio.activeEndpoint() == 3 - first);
+  }
+}
+
+int main()
+{
+  pid_t hubs[2] = {startHub(kPortA), startHub(kPortB)};
+  testProbe();
+  testLatePoll();
+  testUnresolved();
+  testFailover(hubs);
+  stopHub(hubs[0]);
+  stopHub(hubs[1]);
+  return testResult("test_endpoint_race");
+}
@@ -0,0 +1,216 @@
+// Offline journal replay against hub_standin: events emitted before the
+// namespace opens are replayed in order, the backlog drains even while the
+// script keeps emitting far faster than the base replay rate, a namespace
+// the hub rejects does not hold up the others, and controls flushed
+// separately (also across a restart) are merged before replay.
+#include "Arduino.h"
+#include "SioClient.h"
+#include "test_util.h"
+#include <string>
+#include <vector>
+
+namespace
+{
+  const uint16_t kPort = 39301;
+  const uint16_t kRejectPort = 39302;
+  const char *kPath = "/tmp/ch_test_journal.bin";
+
+  void emitSeq(SioClient &sio, int n, const char *nsp = nullptr)
+  {
+    String s = "{\"header\":\"seq\",\"payload\":\"";
+    s += String(n);
+    s += "\"}";
+    sio.emit(nsp, "event", s.c_str());
+  }
+
+  // value is flushed to the file on its own, as after JOURNAL_FLUSH_MS.
+  void emitControl(SioClient &sio, int value)
+  {
+    String s = "{\"header\":\"slider\",\"values\":";
+    s += String(value);
+    s += "}";
+    sio.emit("/hub", "control", s.c_str());
+    sio.journal().flush();
+  }
+
+  bool inOrder(const std::vector<int> &got)
+  {
+    for (size_t i = 0; i < got.size(); ++i)
+      if (got[i] != (int)i)
+        return false;
+    return true;
+  }
+
+  void testDrain()
+  {
+    pid_t hub = startHub(kPort);
+    remove(kPath);
+    SioClient sio;
+    CHECK(sio.enableJournal(kPath));
+    std::vector<int> got;
+    sio.on("event", [&](const char *json, size_t len)
+           {
+             const char *p = strstr(json, "\"payload\":\"");
+             if (p)
+               got.push_back(atoi(p + 11)); });
+    sio.onOpen([&]()
+               {
+                 sio.emit("joinRoom", "{\"room\":\"iot\"}");
+                 sio.emit("observeAllEvents", "{\"observe\":true}"); });
+    sio.begin("127.0.0.1", kPort, "/hub", false, "journal");
+
+    // Not open yet: these go to the journal.
+    const int kOffline = 60;
+    int next = 0;
+    for (; next < kOffline; ++next)
+      emitSeq(sio, next);
+    CHECK(sio.journal().pending());
+
+    // About 1000 live emits per second for one second, queued behind the
+    // backlog; at the base rate alone (80/s) it would never drain.
+    uint32_t start = millis();
+    while (millis() - start < 1000)
+    {
+      sio.loop();
+      if (sio.isOpen())
+        emitSeq(sio, next++);
+      delay(1);
+    }
+    CHECK(runUntil([&]()
+                   { return !sio.journal().pending(); },
+                   [&]()
+                   { sio.loop(); },
+                   500));
+    runUntil([&]()
+             { return (int)got.size() >= next; },
+             [&]()
+             { sio.loop(); },
+             1000);
+    CHECK((int)got.size() == next);
+    CHECK(inOrder(got));
+    fprintf(stderr, "  %d offline + %d live events, %zu received\n", kOffline, next - kOffline, got.size());
+    stopHub(hub);
+    remove(kPath);
+  }
+
+  // The hub answers "40/stage" with a connect error. A /stage message at the
+  // head of the journal stays there, while the default namespace's backlog
+  // is replayed behind it and its live emits are sent straight away.
+  void testRejectedNamespace()
+  {
+    pid_t hub = startHub(kRejectPort, "/stage");
+    remove(kPath);
+    SioClient sio;
+    CHECK(sio.enableJournal(kPath));
+    std::vector<int> got;
+    sio.on("event", [&](const char *json, size_t len)
+           {
+             const char *p = strstr(json, "\"payload\":\"");
+             if (p)
+               got.push_back(atoi(p + 11)); });
+    sio.onOpen([&]()
+               {
+                 sio.emit("joinRoom", "{\"room\":\"iot\"}");
+                 sio.emit("observeAllEvents", "{\"observe\":true}"); });
+    CHECK(sio.addNamespace("/stage"));
+    sio.begin("127.0.0.1", kRejectPort, "/hub", false, "reject");
+
+    emitSeq(sio, 100, "/stage");
+    const int kOffline = 10;
+    int next = 0;
+    for (; next < kOffline; ++next)
+      emitSeq(sio, next);
+    CHECK(runUntil([&]()
+                   { return sio.isOpen(); },
+                   [&]()
+                   { sio.loop(); },
+                   1000));
+    CHECK(runUntil([&]()
+                   { return sio.journal().records("/hub") == 0; },
+                   [&]()
+                   { sio.loop(); },
+                   1000));
+    // Live emits no longer wait for the journal.
+    for (int i = 0; i < 20; ++i, ++next)
+    {
+      emitSeq(sio, next);
+      CHECK(sio.journal().records("/hub") == 0);
+    }
+    runUntil([&]()
+             { return (int)got.size() >= next; },
+             [&]()
+             { sio.loop(); },
+             1000);
+    CHECK((int)got.size() == next);
+    CHECK(inOrder(got));
+    CHECK(!sio.isOpen("/stage"));
+    CHECK(sio.journal().records("/stage") == 1);
+    CHECK(sio.journal().pending());
+    stopHub(hub);
+    remove(kPath);
+  }
+
+  // Five slider values in separate flushes before a restart, three more
+  // after it: begin() merges the first five, the open ack the rest, so only
+  // the last value is replayed, after the event that came before it.
+  void testControlsMerged()
+  {
+    pid_t hub = startHub(kPort);
+    remove(kPath);
+    {
+      SioClient before;
+      CHECK(before.enableJournal(kPath));
+      for (int v = 1; v <= 5; ++v)
+      {
+        emitControl(before, v);
+        if (v == 2)
+        {
+          before.emit("/hub", "event", "{\"header\":\"mid\",\"payload\":\"0\"}");
+          before.journal().flush();
+        }
+      }
+      CHECK(before.journal().records("/hub") == 6);
+    }
+    SioClient sio;
+    CHECK(sio.enableJournal(kPath));
+    CHECK(sio.journal().records("/hub") == 2);
+    std::vector<std::string> got;
+    sio.on("control", [&](const char *json, size_t len)
+           {
+             const char *p = strstr(json, "\"values\":");
+             if (p)
+               got.push_back("control " + std::to_string(atoi(p + 9))); });
+    sio.on("event", [&](const char *json, size_t len)
+           { got.push_back("event"); });
+    sio.onOpen([&]()
+               {
+                 sio.emit("joinRoom", "{\"room\":\"iot\"}");
+                 sio.emit("observeAllControl", "{\"observe\":true}");
+                 sio.emit("observeAllEvents", "{\"observe\":true}"); });
+    sio.begin("127.0.0.1", kPort, "/hub", false, "merge");
+    for (int v = 6; v <= 8; ++v)
+      emitControl(sio, v);
+    CHECK(runUntil([&]()
+                   { return !sio.journal().pending(); },
+                   [&]()
+                   { sio.loop(); },
+                   1000));
+    runUntil([&]()
+             { return got.size() >= 2; },
+             [&]()
+             { sio.loop(); },
+             500);
+    CHECK(got.size() == 2);
+    CHECK(got.size() == 2 && got[0] == "event" && got[1] == "control 8");
+    stopHub(hub);
+    remove(kPath);
+  }
+}
+
+int main()
+{
+  testDrain();
+  testRejectedNamespace();
+  testControlsMerged();
+  return testResult("test_journal_replay");
+}
@@ -0,0 +1,48 @@
+// Namespace slots against hub_standin: handlers registered for the default
+// namespace by name before begin() end up on the one slot that is opened.
+#include "Arduino.h"
+#include "SioClient.h"
+#include "test_util.h"
+
+namespace
+{
+  const uint16_t kPort = 39501;
+}
+
+int main()
+{
+  pid_t hub = startHub(kPort);
+  SioClient sio;
+  int opens = 0;
+  int events = 0;
+  sio.onOpen("/hub", [&]()
+             {
+               opens++;
+               sio.emit("joinRoom", "{\"room\":\"iot\"}");
+               sio.emit("observeAllEvents", "{\"observe\":true}"); });
+  sio.on("/hub", "event", [&](const char *json, size_t len)
+         { events++; });
+  sio.begin("127.0.0.1", kPort, "/hub", false, "nsp");
+  CHECK(runUntil([&]()
+                 { return sio.isOpen("/hub"); },
+                 [&]()
+                 { sio.loop(); },
+                 1000));
+  sio.emit("event", "{\"header\":\"ping\"}");
+  runUntil([&]()
+           { return events > 0; },
+           [&]()
+           { sio.loop(); },
+           500);
+  // A second open ack would run the open handler again.
+  uint32_t start = millis();
+  while (millis() - start < 100)
+  {
+    sio.loop();
+    delay(1);
+  }
+  CHECK(opens == 1);
+  CHECK(events == 1);
+  stopHub(hub);
+  return testResult("test_namespaces");
+}
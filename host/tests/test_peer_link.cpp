@@ -0,0 +1,215 @@
+// LAN peer path over loopback multicast: several PeerLink instances in one
+// process discover each other, exchange controls/events (with their "at"
+// time) and dedupe against hub copies. Then two SioClients on hub_standin
+// check that a timed control is delivered once, at its time, when the
+// peer copy wins the race. A burst that overflows the dedup table must not
+// deliver any message twice.
+#include "Arduino.h"
+#include "SioClient.h"
+#include "test_util.h"
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace
+{
+  const uint16_t kPort = 39401;
+  const size_t kPeers = ChBuffers::kMaxPeers + 1; // every peer table full
+
+  struct Node
+  {
+    PeerLink link;
+    std::vector<std::string> got;
+    void poll()
+    {
+      link.poll(millis(), [this](const char *event, const char *json, size_t len)
+                { got.push_back(std::string(event) + " " + std::string(json, len)); });
+    }
+  };
+
+  bool contains(const std::string &s, const char *part)
+  {
+    return s.find(part) != std::string::npos;
+  }
+
+  void testPeers()
+  {
+    Node nodes[kPeers];
+    Node other; // same port, different room: must see nothing
+    for (size_t i = 0; i < kPeers; ++i)
+      nodes[i].link.begin("iot", ("p" + std::to_string(i)).c_str());
+    other.link.begin("stage", "q");
+    auto pollAll = [&]()
+    {
+      for (Node &n : nodes)
+        n.poll();
+      other.poll();
+    };
+    CHECK(runUntil([&]()
+                   {
+                     for (Node &n : nodes)
+                       if (n.link.peerCount() != kPeers - 1)
+                         return false;
+                     return true; },
+                   pollAll, 3 * PEER_HELLO_MS));
+    CHECK(nodes[0].link.isPeer("p1") && !nodes[0].link.isPeer("q") && !nodes[0].link.isPeer("stranger"));
+
+    CHECK(nodes[0].link.sendControl("fader", 0.5f, true, 12345));
+    CHECK(nodes[0].link.sendEvent("go", "cue 3"));
+    runUntil([&]()
+             {
+               for (size_t i = 1; i < kPeers; ++i)
+                 if (nodes[i].got.size() < 2)
+                   return false;
+               return true; },
+             pollAll, 500);
+    for (size_t i = 1; i < kPeers; ++i)
+    {
+      CHECK(nodes[i].got.size() == 2);
+      if (nodes[i].got.size() != 2)
+        continue;
+      const std::string &c = nodes[i].got[0];
+      CHECK(contains(c, "control ") && contains(c, "\"from\":\"p0\"") && contains(c, "\"at\":12345"));
+      CHECK(contains(nodes[i].got[1], "event ") && contains(nodes[i].got[1], "cue 3"));
+      CHECK(!contains(nodes[i].got[1], "\"at\""));
+      // The hub copy of the same control is now a duplicate, once.
+      CHECK(nodes[i].link.isDuplicate(PeerLink::PathHub, "p0", "fader", 0.5f, millis()));
+      CHECK(!nodes[i].link.isDuplicate(PeerLink::PathHub, "p0", "fader", 0.5f, millis()));
+    }
+    CHECK(nodes[0].got.empty() && other.got.empty());
+  }
+
+  // Live records are never evicted: with every slot taken a new copy is not
+  // remembered, and the older ones still match their other copy. The peer
+  // copy of the one that was not remembered is dropped, not delivered again.
+  void testDedupSlots()
+  {
+    PeerLink link;
+    uint32_t now = 1000;
+    const size_t slots = ChBuffers::kPeerDedupSlots;
+    for (size_t i = 0; i <= slots; ++i)
+      CHECK(!link.isDuplicate(PeerLink::PathHub, "p1", ("h" + std::to_string(i)).c_str(), 1.0f, now));
+    CHECK(link.dedupFull() == 1);
+    CHECK(link.isDuplicate(PeerLink::PathPeer, "p1", "h0", 1.0f, now + 10));
+    CHECK(link.isDuplicate(PeerLink::PathPeer, "p1", ("h" + std::to_string(slots)).c_str(), 1.0f, now + 10));
+    CHECK(link.deferred() == 1);
+    // After PEER_DEDUP_MS the records expire and free their slots.
+    now += PEER_DEDUP_MS + 1;
+    CHECK(!link.isDuplicate(PeerLink::PathPeer, "p1", "h1", 1.0f, now));
+    CHECK(!link.isDuplicate(PeerLink::PathPeer, "p1", "late", 1.0f, now));
+    CHECK(link.dedupFull() == 1);
+  }
+
+  // 60 distinct controls per second for two seconds, with each hub copy
+  // arriving hubLagMs after its peer copy (or before it), so far more copies
+  // wait for their match than the table has slots. Every message must still
+  // be delivered exactly once.
+  void testDedupBurst(int32_t hubLagMs)
+  {
+    PeerLink link;
+    const int kMessages = 120;
+    const uint32_t kIntervalMs = 1000 / 60;
+    struct Copy
+    {
+      uint32_t atMs;
+      PeerLink::Path path;
+      int index;
+    };
+    std::vector<Copy> copies;
+    for (int i = 0; i < kMessages; ++i)
+    {
+      uint32_t peerMs = 1000 + i * kIntervalMs;
+      copies.push_back({peerMs, PeerLink::PathPeer, i});
+      copies.push_back({(uint32_t)(peerMs + hubLagMs), PeerLink::PathHub, i});
+    }
+    std::stable_sort(copies.begin(), copies.end(), [](const Copy &a, const Copy &b)
+                     { return a.atMs < b.atMs; });
+    std::vector<int> delivered(kMessages, 0);
+    for (const Copy &c : copies)
+    {
+      std::string header = "fader" + std::to_string(c.index);
+      if (!link.isDuplicate(c.path, "p1", header.c_str(), 0.5f, c.atMs))
+        delivered[c.index]++;
+    }
+    int wrong = 0;
+    for (int n : delivered)
+      if (n != 1)
+        wrong++;
+    CHECK(link.dedupFull() > 0); // the burst did overflow the table
+    CHECK(wrong == 0);
+    fprintf(stderr, "  hub lag %d ms: %u copies found the table full, %u peer copies deferred, %d not delivered once\n",
+            (int)hubLagMs, link.dedupFull(), link.deferred(), wrong);
+  }
+
+  struct Client
+  {
+    SioClient sio;
+    int controls = 0;
+    int32_t lateMs = 0;
+    uint32_t expectAt = 0;
+
+    void start(const char *name)
+    {
+      sio.enablePeers("iot");
+      sio.enableClockSync("serverTime");
+      sio.onOpen([this, name]()
+                 {
+                   String user = "{\"username\":\"";
+                   user += name;
+                   user += "\"}";
+                   sio.emit("addUsername", user.c_str());
+                   sio.emit("joinRoom", "{\"room\":\"iot\"}");
+                   sio.emit("observeAllControl", "{\"observe\":true}"); });
+      sio.on("control", [this](const char *json, size_t len)
+             {
+               controls++;
+               lateMs = (int32_t)(sio.clock().sharedMs() - expectAt); });
+      sio.begin("127.0.0.1", kPort, "/hub", false, name);
+    }
+  };
+
+  void testTimedDelivery()
+  {
+    pid_t hub = startHub(kPort);
+    Client a, b;
+    a.start("alice");
+    b.start("bob");
+    auto step = [&]()
+    {
+      a.sio.loop();
+      b.sio.loop();
+    };
+    CHECK(runUntil([&]()
+                   { return a.sio.clock().synced() && b.sio.clock().synced() &&
+                            a.sio.peers().isPeer("bob") && b.sio.peers().isPeer("alice"); },
+                   step, 3 * PEER_HELLO_MS));
+
+    uint32_t at = a.sio.clock().sharedMs() + 200;
+    b.expectAt = at;
+    String msg = "{\"header\":\"fader\",\"values\":0.25,\"target\":\"all\",\"at\":";
+    msg += String((unsigned long)at);
+    msg += "}";
+    uint32_t sentPeers = a.sio.peers().sent();
+    a.sio.emit("control", msg.c_str());
+    CHECK(a.sio.peers().sent() == sentPeers + 1);
+    uint32_t start = millis();
+    runUntil([&]()
+             { return millis() - start > 500; },
+             step, 1000);
+    CHECK(b.controls == 1);
+    CHECK(b.lateMs >= -2 && b.lateMs <= 5); // at its time, not on arrival
+    CHECK(b.sio.peers().duplicates() == 1); // the hub copy was dropped
+    fprintf(stderr, "  timed control delivered %d ms from its time\n", (int)b.lateMs);
+    stopHub(hub);
+  }
+}
+
+int main()
+{
+  testPeers();
+  testDedupSlots();
+  testDedupBurst(300);
+  testDedupBurst(-300);
+  testTimedDelivery();
+  return testResult("test_peer_link");
+}
@@ -0,0 +1,297 @@
+// SerialBridge over a pseudo-terminal: a host-side client (the same protocol
+// as tools/serial_bridge.py) sends EMIT packets within its credit window,
+// the device echoes each one back as a MESSAGE, and stray text is written
+// to the port between packets as user code printing would. The first HELLO
+// is lost, some frames the host sends are corrupt or too long, and the hub
+// connection drops and comes back (a STATUS each time). Every message must
+// arrive intact, the credit window must never stall, and the host must never
+// have more than the window in flight.
+#include "Arduino.h"
+#include "SerialBridge.h"
+#include "test_util.h"
+#include <fcntl.h>
+#include <pty.h>
+#include <string>
+#include <termios.h>
+#include <vector>
+
+namespace
+{
+  const uint8_t kEmit = 0x01;
+  const uint8_t kHello = 0x02;
+  const uint8_t kMessage = 0x81;
+  const uint8_t kCredit = 0x82;
+  const uint8_t kStatus = 0x83;
+  const uint8_t kWindow = 0x84;
+
+  // The device's view of the port: the pty master.
+  class FdStream : public Stream
+  {
+  public:
+    explicit FdStream(int fd) : _fd(fd) {}
+    int available() override
+    {
+      if (_pos == _len)
+      {
+        ssize_t n = ::read(_fd, _buf, sizeof(_buf));
+        _pos = 0;
+        _len = n > 0 ? (size_t)n : 0;
+      }
+      return (int)(_len - _pos);
+    }
+    int read() override { return _pos < _len ? _buf[_pos++] : -1; }
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t *buf, size_t n) override
+    {
+      ssize_t w = ::write(_fd, buf, n);
+      return w > 0 ? (size_t)w : 0;
+    }
+    using Print::write;
+    int availableForWrite() override { return 4096; }
+
+  private:
+    int _fd;
+    uint8_t _buf[4096];
+    size_t _pos = 0;
+    size_t _len = 0;
+  };
+
+  uint8_t crc8(const uint8_t *p, size_t n)
+  {
+    uint8_t crc = 0;
+    for (size_t i = 0; i < n; ++i)
+    {
+      crc ^= p[i];
+      for (int b = 0; b < 8; ++b)
+        crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+    }
+    return crc;
+  }
+
+  std::string cobsEncode(const std::string &data)
+  {
+    std::string out(1, '\0');
+    size_t codeIdx = out.size();
+    out += '\1';
+    uint8_t code = 1;
+    for (unsigned char b : data)
+    {
+      if (b == 0)
+      {
+        out[codeIdx] = (char)code;
+        codeIdx = out.size();
+        out += '\1';
+        code = 1;
+        continue;
+      }
+      out += (char)b;
+      if (++code == 0xFF)
+      {
+        out[codeIdx] = (char)code;
+        codeIdx = out.size();
+        out += '\1';
+        code = 1;
+      }
+    }
+    out[codeIdx] = (char)code;
+    out += '\0';
+    return out;
+  }
+
+  bool cobsDecode(const std::string &in, std::string &out)
+  {
+    out.clear();
+    size_t i = 0;
+    while (i < in.size())
+    {
+      uint8_t code = (uint8_t)in[i];
+      if (code == 0 || i + code > in.size())
+        return false;
+      out.append(in, i + 1, code - 1);
+      i += code;
+      if (code < 0xFF && i < in.size())
+        out += '\0';
+    }
+    return true;
+  }
+
+  // Host side of the protocol on the pty slave.
+  struct Host
+  {
+    int fd;
+    int credits = 0;
+    bool synced = false;
+    uint32_t helloAtMs = 0;
+    bool connected = false;
+    int statuses = 0;
+    std::vector<std::string> messages;
+    uint32_t noiseFrames = 0;
+    std::string rx;
+
+    void send(const std::string &pkt, bool corrupt = false)
+    {
+      uint8_t crc = crc8((const uint8_t *)pkt.data(), pkt.size());
+      std::string frame = cobsEncode(pkt + (char)(corrupt ? crc ^ 0x5A : crc));
+      ::write(fd, frame.data(), frame.size());
+    }
+    // Sent again by the loop in main() if nothing comes back in time.
+    void hello(bool corrupt = false)
+    {
+      synced = false;
+      credits = 0;
+      helloAtMs = millis();
+      send(std::string(1, (char)kHello), corrupt);
+    }
+    // A frame the device cannot use still costs a credit.
+    void sendBad(bool tooLong)
+    {
+      if (tooLong)
+      {
+        std::string frame(1, '\0');
+        frame.append(SERIAL_BRIDGE_FRAME_SIZE, 'x');
+        frame += '\0';
+        ::write(fd, frame.data(), frame.size());
+      }
+      else
+      {
+        send(std::string(1, (char)kEmit) + std::string(1, '\0') + "\7control{}", true);
+      }
+      credits--;
+    }
+    void emit(const std::string &event, const std::string &payload)
+    {
+      std::string pkt;
+      pkt += (char)kEmit;
+      pkt += '\0'; // default namespace
+      pkt += (char)event.size();
+      pkt += event;
+      pkt += payload;
+      send(pkt);
+      credits--;
+    }
+    void poll()
+    {
+      char buf[4096];
+      ssize_t n;
+      while ((n = ::read(fd, buf, sizeof(buf))) > 0)
+        rx.append(buf, (size_t)n);
+      size_t zero;
+      while ((zero = rx.find('\0')) != std::string::npos)
+      {
+        std::string frame = rx.substr(0, zero), pkt;
+        rx.erase(0, zero + 1);
+        if (frame.empty())
+          continue;
+        if (!cobsDecode(frame, pkt) || pkt.size() < 2 ||
+            crc8((const uint8_t *)pkt.data(), pkt.size() - 1) != (uint8_t)pkt.back())
+        {
+          noiseFrames++; // text printed between packets
+          continue;
+        }
+        pkt.pop_back();
+        uint8_t type = (uint8_t)pkt[0];
+        if (type == kCredit)
+        {
+          if (synced)
+            credits += (uint8_t)pkt[1];
+        }
+        else if (type == kWindow)
+        {
+          credits = (uint8_t)pkt[1];
+          synced = true;
+        }
+        else if (type == kStatus)
+        {
+          connected = pkt[1] != 0;
+          statuses++;
+        }
+        else if (type == kMessage)
+        {
+          size_t nspLen = (uint8_t)pkt[1];
+          size_t evLen = (uint8_t)pkt[2 + nspLen];
+          messages.push_back(pkt.substr(3 + nspLen + evLen));
+        }
+      }
+    }
+  };
+}
+
+int main()
+{
+  int master, slave;
+  CHECK(openpty(&master, &slave, nullptr, nullptr, nullptr) == 0);
+  termios t;
+  tcgetattr(slave, &t);
+  cfmakeraw(&t);
+  tcsetattr(slave, TCSANOW, &t);
+  fcntl(master, F_SETFL, O_NONBLOCK);
+  fcntl(slave, F_SETFL, O_NONBLOCK);
+
+  FdStream port(master);
+  SerialBridge bridge;
+  Host host{slave};
+  int emits = 0;
+  bridge.begin(port, [&](const char *nsp, const char *event, const char *payload)
+               {
+                 emits++;
+                 bridge.sendMessage(nsp, event, payload, strlen(payload));
+                 // What a printing handler or loop() status line would do.
+                 if (emits % 7 == 0)
+                   port.print("[user_script] Control: {\"header\":\"x\"}\r\n"); });
+  port.print("[Collab-Hub ESP32] Booting...\r\n");
+
+  host.hello(true);
+  const int kCount = 1000;
+  int sent = 0;
+  uint32_t bad = 0;
+  int nextBad = 36;
+  int overCommitted = 0;
+  int polls = 0;
+  uint32_t start = millis();
+  while ((int)host.messages.size() < kCount && millis() - start < 5000)
+  {
+    if (!host.synced && millis() - host.helloAtMs > 100)
+      host.hello();
+    while (host.synced && host.credits > 1 && sent < kCount)
+    {
+      if (sent == nextBad)
+      {
+        host.sendBad(bad % 4 == 3);
+        bad++;
+        nextBad += 37;
+      }
+      std::string payload = "{\"header\":\"s\",\"values\":" + std::to_string(sent) + "}";
+      payload.resize(payload.size() + (size_t)(sent % 300), ' ');
+      host.emit("control", payload);
+      sent++;
+    }
+    // Frames sent but not yet read by the device, plus credits the host
+    // still holds: the window, never more.
+    int inFlight = sent + (int)bad - emits - (int)bridge.rejected() + 1;
+    if (host.synced && host.credits + inFlight > SERIAL_BRIDGE_WINDOW)
+      overCommitted++;
+    bridge.poll(++polls % 40 != 0);
+    host.poll();
+  }
+  bridge.poll(true);
+  host.poll();
+  CHECK(host.statuses > 2);
+  CHECK(host.connected);
+  CHECK(overCommitted == 0);
+  CHECK(sent == kCount);
+  CHECK((int)host.messages.size() == kCount);
+  bool intact = true;
+  for (size_t i = 0; i < host.messages.size(); ++i)
+    intact = intact && host.messages[i].rfind("{\"header\":\"s\",\"values\":" + std::to_string(i) + "}", 0) == 0 &&
+             host.messages[i].size() == 24 + std::to_string(i).size() + i % 300;
+  CHECK(intact);
+  CHECK(bad > 20);
+  CHECK(bridge.rejected() == bad + 1); // and the lost HELLO
+  CHECK(bridge.dropped() == 0);
+  CHECK(host.noiseFrames > 0); // the text was there, and was skipped
+  fprintf(stderr, "  %d messages in %u ms, %u text frames skipped\n", (int)host.messages.size(),
+          (unsigned)(millis() - start), host.noiseFrames);
+  close(master);
+  close(slave);
+  return testResult("test_serial_bridge");
+}
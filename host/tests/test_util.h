@@ -0,0 +1,85 @@
+#pragma once
+// Helpers shared by the host tests: a CHECK that reports and counts
+// failures, a hub_standin child process, and a wait-while-looping helper.
+#include "Arduino.h"
+#include <functional>
+#include <netinet/in.h>
+#include <signal.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static int testFailures = 0;
+
+#define CHECK(cond)                                                   \
+  do                                                                  \
+  {                                                                   \
+    if (!(cond))                                                      \
+    {                                                                 \
+      fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, \
+              #cond);                                                 \
+      testFailures++;                                                 \
+    }                                                                 \
+  } while (0)
+
+inline int testResult(const char *name)
+{
+  fprintf(stderr, "%s: %s\n", name, testFailures ? "FAILED" : "ok");
+  return testFailures ? 1 : 0;
+}
+
+// Starts ./hub_standin on port and waits until it accepts connections.
+// rejectNsp is passed as --reject.
+inline pid_t startHub(uint16_t port, const char *rejectNsp = nullptr)
+{
+  char arg[8];
+  snprintf(arg, sizeof(arg), "%u", port);
+  pid_t pid = fork();
+  if (pid == 0)
+  {
+    freopen("/dev/null", "w", stderr);
+    if (rejectNsp)
+      execl("./hub_standin", "hub_standin", "--port", arg, "--reject", rejectNsp, (char *)nullptr);
+    else
+      execl("./hub_standin", "hub_standin", "--port", arg, (char *)nullptr);
+    _exit(127);
+  }
+  for (int i = 0; i < 200; ++i)
+  {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bool up = connect(fd, (sockaddr *)&addr, sizeof(addr)) == 0;
+    close(fd);
+    if (up)
+      return pid;
+    delay(10);
+  }
+  fprintf(stderr, "hub_standin did not start on port %u\n", port);
+  return pid;
+}
+
+inline void stopHub(pid_t pid)
+{
+  if (pid <= 0)
+    return;
+  kill(pid, SIGTERM);
+  waitpid(pid, nullptr, 0);
+}
+
+// Calls step() until done() is true or ms have passed; returns done().
+inline bool runUntil(std::function<bool()> done, std::function<void()> step, uint32_t ms)
+{
+  uint32_t start = millis();
+  while (!done())
+  {
+    if (millis() - start > ms)
+      return false;
+    step();
+    delay(1);
+  }
+  return true;
+}
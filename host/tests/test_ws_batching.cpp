@@ -0,0 +1,117 @@
+// Wire-level check of the WebSocket write path: the onOpen emits batched
+// with beginBatch()/flush() leave in one TCP segment, and a single emit
+// leaves at once with TCP_NODELAY set, on both the plain and the
+// WiFiClientSecure client. Against a hub that never answers the upgrade,
+// neither begin() nor loop() waits for it.
+#include "Arduino.h"
+#include "WiFiClient.h"
+#include "SioClient.h"
+#include "test_util.h"
+#include <algorithm>
+#include <linux/tcp.h>
+
+namespace
+{
+  const uint16_t kPort = 39127;
+  const uint16_t kSilentPort = 39128;
+
+  // Data-carrying segments sent on fd so far (pure ACKs are not counted).
+  uint32_t dataSegmentsOut(int fd)
+  {
+    tcp_info info = {};
+    socklen_t len = sizeof(info);
+    if (getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &len) != 0)
+      return 0;
+    return info.tcpi_data_segs_out;
+  }
+
+  bool noDelay(int fd)
+  {
+    int on = 0;
+    socklen_t len = sizeof(on);
+    return getsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, &len) == 0 && on;
+  }
+
+  void run(bool useTls)
+  {
+    int fd = -1;
+    WiFiClient::setSocketHook([&fd](int s, WiFiClient::SocketEvent event)
+                              {
+                                if (event == WiFiClient::SocketOpen)
+                                  fd = s;
+                                else if (event == WiFiClient::SocketClose)
+                                  fd = -1; });
+    SioClient sio;
+    uint32_t batchSegments = 0;
+    sio.onOpen([&]()
+               {
+                 uint32_t before = dataSegmentsOut(fd);
+                 sio.beginBatch();
+                 sio.emit("addUsername", "{\"username\":\"t\"}");
+                 sio.emit("joinRoom", "{\"room\":\"iot\"}");
+                 sio.emit("observeAllControl", "{\"observe\":true}");
+                 sio.emit("observeAllEvents", "{\"observe\":true}");
+                 sio.flush();
+                 batchSegments = dataSegmentsOut(fd) - before; });
+    sio.begin("127.0.0.1", kPort, "/hub", useTls, "t");
+    CHECK(fd >= 0);
+    CHECK(runUntil([&]()
+                   { return sio.isOpen(); },
+                   [&]()
+                   { sio.loop(); },
+                   2000));
+    CHECK(batchSegments == 1);
+    CHECK(noDelay(fd));
+
+    // Back to back: with Nagle the second would wait for the first's ACK.
+    uint32_t before = dataSegmentsOut(fd);
+    sio.emit("control", "{\"header\":\"a\",\"values\":1,\"target\":\"all\"}");
+    CHECK(dataSegmentsOut(fd) - before == 1);
+    sio.emit("control", "{\"header\":\"a\",\"values\":2,\"target\":\"all\"}");
+    CHECK(dataSegmentsOut(fd) - before == 2);
+    WiFiClient::setSocketHook(nullptr);
+  }
+
+  // The kernel completes the TCP connect from the listen backlog, but no
+  // upgrade response ever comes.
+  void runSilentHub()
+  {
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    int on = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(kSilentPort);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    CHECK(bind(listener, (sockaddr *)&addr, sizeof(addr)) == 0 && listen(listener, 4) == 0);
+
+    SioClient sio;
+    uint32_t start = micros();
+    sio.begin("127.0.0.1", kSilentPort, "/hub", false, "t");
+    uint32_t beginUs = micros() - start;
+    uint32_t worstLoopUs = 0;
+    start = millis();
+    while (millis() - start < 200)
+    {
+      uint32_t t = micros();
+      sio.loop();
+      worstLoopUs = std::max(worstLoopUs, micros() - t);
+      delay(1);
+    }
+    CHECK(beginUs < 20000);
+    CHECK(worstLoopUs < 20000);
+    CHECK(sio.connected() && !sio.isOpen());
+    fprintf(stderr, "  silent hub: begin() %u us, longest loop() %u us\n", beginUs, worstLoopUs);
+    close(listener);
+  }
+}
+
+int main()
+{
+  pid_t hub = startHub(kPort);
+  run(false);
+  run(true);
+  stopHub(hub);
+  runSilentHub();
+  return testResult("test_ws_batching");
+}
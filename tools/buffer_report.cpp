@@ -0,0 +1,27 @@
+// Host-side report of the Collab-Hub client buffer footprint per config.
+//
+//   g++ -std=c++11 -I CollabHubESP32 tools/buffer_report.cpp -o buffer_report && ./buffer_report
+//
+// Pass the same -D overrides as your config.h (e.g. -DCH_MAX_FRAME_SIZE=1024)
+// to see the effect on DefaultBufferConfig, and -DSERIAL_BRIDGE=1 to include
+// the serial bridge. Slot sizes are ESP32 estimates (Esp32SlotSizes); the
+// sketch build checks the budget with the real ones.
+#include <cstdio>
+#include "BufferConfig.h"
+
+template <class Cfg>
+static void report(const char *name)
+{
+  typedef BufferBudget<Cfg> B;
+  printf("%-20s %8zu %8zu %8zu %8zu %8zu  %s\n", name,
+         B::staticBytes, B::stackBytes, B::heapBytes, B::totalBytes, Cfg::kRamBudget,
+         (B::fitsStack && B::fitsRam && B::valid) ? "ok" : "OVER BUDGET");
+}
+
+int main()
+{
+  printf("%-20s %8s %8s %8s %8s %8s\n", "config", "static", "stack", "heap", "total", "budget");
+  report<DefaultBufferConfig>("DefaultBufferConfig");
+  report<SmallBufferConfig>("SmallBufferConfig");
+  return 0;
+}
@@ -0,0 +1,153 @@
+#!/usr/bin/env python3
+"""Reference host side of the SerialBridge protocol (see SerialBridge.h).
+
+    python3 tools/serial_bridge.py /dev/ttyUSB0 --rate 1000 --header slider1
+
+Sends "control" messages at the given rate while printing everything the
+device forwards from the hub. Needs pyserial.
+"""
+import argparse
+import json
+import sys
+import time
+
+EMIT, HELLO = 0x01, 0x02
+MESSAGE, CREDIT, STATUS, WINDOW = 0x81, 0x82, 0x83, 0x84
+MAX_PACKET = 512  # SERIAL_BRIDGE_PACKET_SIZE, CRC included
+RESYNC_TIMEOUT = 0.5  # seconds without an answer before HELLO is sent again
+
+
+def crc8(data):
+    crc = 0
+    for b in data:
+        crc ^= b
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x07) & 0xFF if crc & 0x80 else (crc << 1) & 0xFF
+    return crc
+
+
+def cobs_encode(data):
+    out = bytearray(b"\x00")
+    code_idx, code = 0, 1
+    for b in data:
+        if b == 0:
+            out[code_idx] = code
+            code_idx, code = len(out), 1
+            out.append(0)
+            continue
+        out.append(b)
+        code += 1
+        if code == 0xFF:
+            out[code_idx] = code
+            code_idx, code = len(out), 1
+            out.append(0)
+    out[code_idx] = code
+    out.append(0)
+    return bytes(out)
+
+
+def cobs_decode(data):
+    out, i = bytearray(), 0
+    while i < len(data):
+        code = data[i]
+        if code == 0 or i + code > len(data):
+            return None
+        out += data[i + 1:i + code]
+        i += code
+        if code < 0xFF and i < len(data):
+            out.append(0)
+    return bytes(out)
+
+
+class Bridge:
+    def __init__(self, port, max_packet=MAX_PACKET):
+        self.port = port
+        self.max_packet = max_packet
+        self.credits = 0
+        self.synced = False
+        self.heard_at = time.monotonic()
+        self.rx = bytearray()
+
+    def _send(self, pkt):
+        self.port.write(cobs_encode(pkt + bytes([crc8(pkt)])))
+
+    def hello(self):
+        """Asks for a fresh window; emit() waits until the device answers."""
+        self.synced = False
+        self.credits = 0
+        self.heard_at = time.monotonic()
+        self._send(bytes([HELLO]))
+
+    def emit(self, event, payload, nsp=""):
+        """Returns False when out of credits; call poll() and retry."""
+        n, e = nsp.encode(), event.encode()
+        pkt = bytes([EMIT, len(n)]) + n + bytes([len(e)]) + e + payload.encode()
+        if len(n) > 255 or len(e) > 255 or len(pkt) + 1 > self.max_packet:
+            raise ValueError("packet of %d bytes exceeds the device's %d" % (len(pkt) + 1, self.max_packet))
+        if not self.synced or self.credits == 0:
+            return False
+        self._send(pkt)
+        self.credits -= 1
+        if self.credits == 0:
+            self.heard_at = time.monotonic()
+        return True
+
+    def poll(self):
+        """Yields (type, fields) for every valid packet received."""
+        # A lost HELLO or WINDOW, or credits lost to line noise, would stall
+        # the sender for good; ask again.
+        waiting = not self.synced or self.credits == 0
+        if waiting and time.monotonic() - self.heard_at > RESYNC_TIMEOUT:
+            self.hello()
+        self.rx += self.port.read(self.port.in_waiting or 1)
+        while b"\x00" in self.rx:
+            frame, _, self.rx = self.rx.partition(b"\x00")
+            pkt = cobs_decode(bytes(frame)) if frame else None
+            if not pkt or len(pkt) < 2 or crc8(pkt[:-1]) != pkt[-1]:
+                continue  # boot text or noise
+            pkt = pkt[:-1]
+            if pkt[0] == CREDIT:
+                if self.synced:  # otherwise the coming WINDOW covers it
+                    self.credits += pkt[1]
+                    self.heard_at = time.monotonic()
+            elif pkt[0] == WINDOW:
+                # Only sent in answer to HELLO; STATUS never changes credits.
+                self.credits = pkt[1]
+                self.synced = True
+                self.heard_at = time.monotonic()
+            elif pkt[0] == STATUS:
+                yield "status", {"connected": bool(pkt[1]), "dropped": int.from_bytes(pkt[2:6], "little")}
+            elif pkt[0] == MESSAGE:
+                nl = pkt[1]
+                el = pkt[2 + nl]
+                yield "message", {"nsp": pkt[2:2 + nl].decode(), "event": pkt[3 + nl:3 + nl + el].decode(),
+                                  "payload": pkt[3 + nl + el:].decode(errors="replace")}
+
+
+def main():
+    import serial
+
+    ap = argparse.ArgumentParser()
+    ap.add_argument("device")
+    ap.add_argument("--baud", type=int, default=921600)
+    ap.add_argument("--rate", type=float, default=0, help="control messages per second (0 = listen only)")
+    ap.add_argument("--header", default="slider1")
+    args = ap.parse_args()
+
+    bridge = Bridge(serial.Serial(args.device, args.baud, timeout=0.001))
+    bridge.hello()
+    period = 1.0 / args.rate if args.rate > 0 else None
+    next_send = time.monotonic()
+    sent = 0
+    while True:
+        for kind, fields in bridge.poll():
+            print(kind, fields, file=sys.stderr)
+        if period and time.monotonic() >= next_send:
+            payload = json.dumps({"header": args.header, "values": sent % 128, "mode": "publish", "target": "all"})
+            if bridge.emit("control", payload, ""):
+                sent += 1
+                next_send += period
+
+
+if __name__ == "__main__":
+    main()